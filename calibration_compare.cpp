@@ -28,6 +28,7 @@
 #include <fstream>
 #include <math.h>
 #include "opencv_headers.h"
+#include "calibration_rotation.h"
 
 using namespace std;
 
@@ -292,6 +293,7 @@ int main()
 
         // define output data structures
         cv::Mat lsTranMat;
+        cv::Mat lsRotation;
         cv::Mat rmTranMat;
         cv::Mat cameraRotation;
         cv::Mat cameraPosition;
@@ -303,7 +305,10 @@ int main()
         cout << "---- least squares ----" << endl;
         logFile << "---- least squares ----" << endl;
         lsCalTransformationMatrix(cameraPoints, worldPoints, lsTranMat);
-        decomposeRotation(lsTranMat);
+        double distance = projectRotation(lsTranMat, lsRotation);
+        cout << "distance to rotation: " << distance << endl;
+        logFile << "distance to rotation: " << distance << endl;
+        decomposeRotation(lsRotation);
 
         // for rigid motion
         cout << "---- rigid motion ----" << endl;
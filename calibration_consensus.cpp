@@ -0,0 +1,142 @@
+//
+//  calibration_consensus.cpp
+//  Algorithm
+//
+//  combines repeated calibrations of one Kinect into one consensus transformation
+//  every calibration saved by calibration_rigid_motion.cpp or calibration_least_squares.cpp is loaded,
+//  its rotation part is projected onto the nearest rotation, since the least squares result is affine,
+//  and all rotations are converted to Euler angles and quaternions as one batch
+//  - the consensus rotation is the chordal median of the rotations, so a few bad calibrations
+//    don't pull it away; the chordal mean is printed beside it for comparison
+//  - the consensus position is the geometric median of the positions
+//  - the angle and distance of every calibration to the consensus show which ones to repeat
+//
+//  input: data/transform_<name>.yml of every calibration
+//  output: Euler angles and quaternion of every calibration and its distance to the consensus
+//  output: consensus transformation matrix saved to data/transform_<output name>.yml for calibration_point_cloud.cpp
+//  command line: [-o output name] calibration names
+//
+
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <string.h>
+#include <math.h>
+#include "opencv_headers.h"
+#include "calibration_rotation.h"
+
+using namespace std;
+
+ofstream logFile;
+
+
+// write a line to both standard output and the log file
+void logLine(const string& line)
+{
+    cout << line << endl;
+    logFile << line << endl;
+}
+
+int main(int argc, const char * argv[])
+{
+    string outputName = "consensus";
+    vector<string> names;
+    for(int i=1; i<argc; ++i)
+    {
+        if(strcmp(argv[i], "-o")==0 && i+1<argc)
+            outputName = argv[++i];
+        else
+            names.push_back(argv[i]);
+    }
+    if(names.empty())
+    {
+        cout << "usage: calibration_consensus [-o output name] calibration names" << endl;
+        return 1;
+    }
+
+    // create log file
+    string filepath = "data/consensus_"+outputName+".txt";
+    logFile.open(filepath.c_str(), ios::trunc);
+
+    // load every calibration and keep the rotation nearest to its rotation part
+    ROTATION_BATCH rotations;
+    vector<cv::Point3_<float> > positions;
+    vector<string> loaded;
+    vector<double> deviations;
+    char line[256];
+    for(size_t i=0; i<names.size(); ++i)
+    {
+        cv::Mat tranMat, rotation;
+        if(!loadTransformation(tranMat, names[i]))
+        {
+            logLine("can't load calibration "+names[i]);
+            continue;
+        }
+        deviations.push_back(projectRotation(tranMat, rotation));
+        addRotation(rotations, rotation);
+        positions.push_back(cv::Point3_<float>(tranMat.at<float>(0,3), tranMat.at<float>(1,3), tranMat.at<float>(2,3)));
+        loaded.push_back(names[i]);
+    }
+    if(loaded.empty())
+        return 1;
+
+    // angles and quaternions of all calibrations at once
+    vector<float> radX, radY, radZ, qw, qx, qy, qz;
+    batchEuler(rotations, radX, radY, radZ);
+    batchQuaternions(rotations, qw, qx, qy, qz);
+
+    // consensus rotation and position
+    cv::Mat meanRotation, medianRotation;
+    cv::Point3_<float> medianPosition;
+    chordalMean(rotations, meanRotation);
+    int iterations = chordalMedian(rotations, medianRotation);
+    positionMedian(positions, medianPosition);
+
+    // every calibration with its distance to the consensus
+    for(size_t i=0; i<loaded.size(); ++i)
+    {
+        cv::Mat rotation;
+        getRotation(rotations, i, rotation);
+        double dx = positions[i].x-medianPosition.x;
+        double dy = positions[i].y-medianPosition.y;
+        double dz = positions[i].z-medianPosition.z;
+        logLine("calibration "+loaded[i]+":");
+        snprintf(line, sizeof(line), "degree x: %g, y: %g, z: %g", radX[i]*180.0/M_PI, radY[i]*180.0/M_PI, radZ[i]*180.0/M_PI);
+        logLine(line);
+        snprintf(line, sizeof(line), "quaternion: %g %g %g %g", qw[i], qx[i], qy[i], qz[i]);
+        logLine(line);
+        snprintf(line, sizeof(line), "distance to rotation: %g", deviations[i]);
+        logLine(line);
+        snprintf(line, sizeof(line), "to consensus: %g degree, %g position", rotationAngle(rotation, medianRotation)*180.0/M_PI, sqrt(dx*dx+dy*dy+dz*dz));
+        logLine(line);
+        logLine("");
+    }
+
+    // transformation matrix of the consensus
+    cv::Mat tranMat = cv::Mat::zeros(4,4,CV_32F);
+    for(int i=0; i<3; ++i)
+        for(int j=0; j<3; ++j)
+            tranMat.at<float>(i,j) = medianRotation.at<float>(i,j);
+    tranMat.at<float>(0,3) = medianPosition.x;
+    tranMat.at<float>(1,3) = medianPosition.y;
+    tranMat.at<float>(2,3) = medianPosition.z;
+    tranMat.at<float>(3,3) = 1;
+
+    ROTATION_BATCH consensus;
+    addRotation(consensus, medianRotation);
+    batchEuler(consensus, radX, radY, radZ);
+    snprintf(line, sizeof(line), "consensus of %d calibrations, median after %d iterations", (int)loaded.size(), iterations);
+    logLine(line);
+    snprintf(line, sizeof(line), "degree x: %g, y: %g, z: %g", radX[0]*180.0/M_PI, radY[0]*180.0/M_PI, radZ[0]*180.0/M_PI);
+    logLine(line);
+    snprintf(line, sizeof(line), "mean rotation to consensus: %g degree", rotationAngle(meanRotation, medianRotation)*180.0/M_PI);
+    logLine(line);
+    cout << "transformation matrix:" << tranMat << endl << endl;
+    logFile << "transformation matrix:" << tranMat << endl << endl;
+
+    saveTransformation(tranMat, outputName);
+    logFile.close();
+    return 0;
+}
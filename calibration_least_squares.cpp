@@ -15,8 +15,9 @@
 //
 //  input: camera points, world points
 //  output: transformation matrix from camera coordinate to world coordinate
-//  output: position and rotation of Kinect in world coordinate
+//  output: position and rotation of Kinect in world coordinate, angles of the rotation nearest to the affine matrix
 //  output: mean squared error for given testing file
+//  output: transformation matrix saved to data/transform_<file name>.yml for calibration_point_cloud.cpp
 //
 
 
@@ -24,6 +25,7 @@
 #include <fstream>
 #include <math.h>
 #include "opencv_headers.h"
+#include "calibration_rotation.h"
 
 using namespace std;
 
@@ -206,7 +208,7 @@ int main()
         // define output data structures
         cv::Mat tranMat;
         cv::Vec3f cameraPosition;
-        cv::Vec3f cameraRotation;
+        cv::Mat cameraRotation;
 
         // load input data from file to data structures
         readCalibrationData(cameraPoints, worldPoints, fileName);
@@ -215,7 +217,14 @@ int main()
         calTransformationMatrix(cameraPoints, worldPoints, tranMat);
 
         // decompose rotation and position info from transformation matrix
-        decomposeRotation(tranMat);
+        // the least squares matrix is affine, so the angles are the ones of the rotation nearest to it
+        double distance = projectRotation(tranMat, cameraRotation);
+        cout << "distance to rotation: " << distance << endl;
+        logFile << "distance to rotation: " << distance << endl;
+        decomposeRotation(cameraRotation);
+
+        // save transformation matrix for calibration_point_cloud.cpp
+        saveTransformation(tranMat, fileName);
 
         // get testing file
         string testFileName;
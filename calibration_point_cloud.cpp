@@ -0,0 +1,540 @@
+//
+//  calibration_point_cloud.cpp
+//  Algorithm
+//
+//  applies the calibration of every Kinect to its depth stream, frame by frame in real time
+//  every depth frame is back-projected to 3D points in the camera coordinate and mapped to the world
+//  coordinate with the transformation matrix saved by calibration_rigid_motion.cpp or
+//  calibration_least_squares.cpp
+//
+//  - depth pixel (u,v) with depth d is the camera point d*((u-cx)/fx, (v-cy)/fy, 1), so its world point
+//    is d*R*ray(u,v) + t; the rotated rays are computed once per sensor, so a frame costs three
+//    multiply-adds per coordinate of a pixel, done for 8 pixels at once with compiler vector types
+//  - depth frames, rays and world points live in buffers allocated once per sensor,
+//    so processing a frame allocates nothing
+//  - every sensor is one job of a pool with one worker per sensor, all sensors of a frame run in parallel
+//  pixels without depth get NaN world points, so the output keeps the layout of the depth image
+//
+//  the world points of all sensors are fused into one sparse voxel grid, so overlapping views of the
+//  same surface end up as one point per voxel instead of one point per sensor and frame
+//  - the grid is a hash table of blocks of 8x8x8 voxels keyed by block coordinate, with a fixed number
+//    of blocks allocated up front, so its memory doesn't grow with the number of frames
+//  - sensors integrate in parallel without locks: a block is claimed by a compare-and-swap of its key,
+//    and a voxel accumulates its point count and the sum of the positions of its points inside the voxel
+//    with atomic adds
+//  - once the blocks run out, points falling into new blocks are dropped and counted
+//  the fused point cloud has the centroid of the points of every occupied voxel
+//
+//  input: data/transform_<name>.yml with the transformation matrix of every sensor
+//  input: data/<name>.depth with its depth frames, width*height 16-bit depths per frame
+//  output: frames and points per second, size of the fused point cloud
+//  output: the fused point cloud with -o, the world points of the last frame of every sensor with -raw
+//  command line: [-size width height] [-intrinsics fx fy cx cy] [-scale meters per depth unit]
+//                [-voxel size] [-blocks count] [-o points file] [-raw points file] sensor names
+//
+
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "opencv_headers.h"
+#include "calibration_rotation.h"
+
+using namespace std;
+
+// intrinsics of the depth camera, the defaults are the usual ones of a Kinect
+typedef struct _intrinsics
+{
+    int width;
+    int height;
+    float fx, fy;       // focal lengths in pixels
+    float cx, cy;       // principal point
+    float scale;        // world units per depth unit, depth in millimeters and world in meters by default
+}INTRINSICS;
+
+// one Kinect with its calibration and the buffers of its current frame
+typedef struct _sensor
+{
+    string name;
+    FILE* depthFile;
+    float rot[9];                       // rotation from camera to world coordinate, row after row
+    float pos[3];                       // position of the camera in world coordinate
+    vector<unsigned short> depth;       // current depth frame
+    vector<float> rayX, rayY, rayZ;     // rotated ray of every pixel, scaled to world units per depth unit
+    vector<float> worldX, worldY, worldZ;   // world point of every pixel of the current frame
+    bool hasFrame;
+    long long frames;
+}SENSOR;
+
+// pool with one worker per sensor, all workers process one frame and the caller waits for them
+typedef struct _frame_pool
+{
+    vector<thread> workers;
+    mutex lock;
+    condition_variable start;
+    condition_variable done;
+    long long frame;    // number of the last frame handed to the workers
+    int pending;        // workers still processing it
+    bool stop;
+}FRAME_POOL;
+
+// voxels of a block along every axis, 8 is 1<<BLOCK_BITS
+#define BLOCK_BITS 3
+#define BLOCK_VOXELS (1<<(3*BLOCK_BITS))
+// position sums count 1/256 of a voxel per unit, a voxel stops at 2^24 points so the sums can't overflow
+#define VOXEL_STEPS 256
+#define VOXEL_MAX_POINTS (1u<<24)
+// block coordinates are packed into 21 bits each, so a key is never EMPTY_KEY
+#define BLOCK_COORD_BITS 21
+#define EMPTY_KEY (~0ull)
+
+typedef struct _voxel
+{
+    atomic<unsigned int> count;
+    atomic<unsigned int> sum[3];    // positions of the points relative to the low corner of the voxel
+}VOXEL;
+
+// sparse voxel grid shared by all sensors
+typedef struct _voxel_grid
+{
+    float voxel;                            // edge of a voxel in world units
+    size_t slots;                           // size of the hash table, a bit more than maxBlocks
+    size_t maxBlocks;
+    vector<atomic<unsigned long long> > keys;   // block of every slot, EMPTY_KEY if free
+    vector<VOXEL> voxels;                   // BLOCK_VOXELS voxels per slot
+    atomic<size_t> blocks;                  // slots claimed
+    atomic<long long> dropped;              // points that found no free block
+}VOXEL_GRID;
+
+#if defined(__GNUC__)
+// 8 pixels at once, one AVX register or two SSE registers
+typedef float floatv __attribute__((vector_size(32)));
+typedef int intv __attribute__((vector_size(32)));
+typedef unsigned short depthv __attribute__((vector_size(16)));
+#define PIXEL_LANES (sizeof(floatv)/sizeof(float))
+#endif
+
+INTRINSICS intrinsics = {640, 480, 594.21f, 591.04f, 339.5f, 242.7f, 0.001f};
+VOXEL_GRID grid;
+
+
+// load the rotation and position of a sensor from the transformation matrix saved by its calibration
+bool loadSensorTransformation(SENSOR& sensor)
+{
+    cv::Mat tranMat;
+    if(!loadTransformation(tranMat, sensor.name))
+        return false;
+
+    for(int i=0; i<3; ++i)
+    {
+        for(int j=0; j<3; ++j)
+            sensor.rot[i*3+j] = tranMat.at<float>(i,j);
+        sensor.pos[i] = tranMat.at<float>(i,3);
+    }
+    return true;
+}
+
+// allocate the buffers of a sensor and compute the rotated ray of every pixel
+void initSensor(SENSOR& sensor)
+{
+    size_t pixels = (size_t)intrinsics.width*intrinsics.height;
+    sensor.depth.assign(pixels, 0);
+    sensor.rayX.resize(pixels);
+    sensor.rayY.resize(pixels);
+    sensor.rayZ.resize(pixels);
+    sensor.worldX.assign(pixels, NAN);
+    sensor.worldY.assign(pixels, NAN);
+    sensor.worldZ.assign(pixels, NAN);
+    sensor.hasFrame = true;
+    sensor.frames = 0;
+
+    const float* r = sensor.rot;
+    for(int v=0; v<intrinsics.height; ++v)
+    {
+        for(int u=0; u<intrinsics.width; ++u)
+        {
+            // ray in camera coordinate with depth 1
+            float x = (u-intrinsics.cx)/intrinsics.fx*intrinsics.scale;
+            float y = (v-intrinsics.cy)/intrinsics.fy*intrinsics.scale;
+            float z = intrinsics.scale;
+            size_t i = (size_t)v*intrinsics.width+u;
+            sensor.rayX[i] = r[0]*x + r[1]*y + r[2]*z;
+            sensor.rayY[i] = r[3]*x + r[4]*y + r[5]*z;
+            sensor.rayZ[i] = r[6]*x + r[7]*y + r[8]*z;
+        }
+    }
+}
+
+// map the current depth frame of a sensor to world points
+void transformFrame(SENSOR& sensor)
+{
+    size_t pixels = sensor.depth.size();
+    size_t i = 0;
+    const unsigned short* depth = sensor.depth.data();
+
+#if defined(__GNUC__)
+    floatv tx = floatv{} + sensor.pos[0];
+    floatv ty = floatv{} + sensor.pos[1];
+    floatv tz = floatv{} + sensor.pos[2];
+    intv nan = (intv)(floatv{} + NAN);
+    for(; i+PIXEL_LANES<=pixels; i+=PIXEL_LANES)
+    {
+        depthv d;
+        floatv rx, ry, rz;
+        memcpy(&d, depth+i, sizeof(d));
+        memcpy(&rx, &sensor.rayX[i], sizeof(rx));
+        memcpy(&ry, &sensor.rayY[i], sizeof(ry));
+        memcpy(&rz, &sensor.rayZ[i], sizeof(rz));
+        floatv z = __builtin_convertvector(d, floatv);
+
+        // pixels without depth are NaN
+        intv valid = z > 0;
+        intv x = ((intv)(z*rx + tx) & valid) | (nan & ~valid);
+        intv y = ((intv)(z*ry + ty) & valid) | (nan & ~valid);
+        intv w = ((intv)(z*rz + tz) & valid) | (nan & ~valid);
+        memcpy(&sensor.worldX[i], &x, sizeof(x));
+        memcpy(&sensor.worldY[i], &y, sizeof(y));
+        memcpy(&sensor.worldZ[i], &w, sizeof(w));
+    }
+#endif
+
+    for(; i<pixels; ++i)
+    {
+        float z = depth[i];
+        sensor.worldX[i] = z>0 ? z*sensor.rayX[i] + sensor.pos[0] : NAN;
+        sensor.worldY[i] = z>0 ? z*sensor.rayY[i] + sensor.pos[1] : NAN;
+        sensor.worldZ[i] = z>0 ? z*sensor.rayZ[i] + sensor.pos[2] : NAN;
+    }
+}
+
+// allocate a grid of voxels of the given size with room for maxBlocks blocks
+// the hash table gets a fifth more slots than blocks, so probing stays short when it is full
+void initGrid(VOXEL_GRID& grid, float voxel, size_t maxBlocks)
+{
+    grid.voxel = voxel;
+    grid.maxBlocks = maxBlocks;
+    grid.slots = maxBlocks + maxBlocks/4 + 64;
+    vector<atomic<unsigned long long> > keys(grid.slots);
+    vector<VOXEL> voxels(grid.slots*BLOCK_VOXELS);
+    grid.keys.swap(keys);
+    grid.voxels.swap(voxels);
+    for(size_t i=0; i<grid.slots; ++i)
+        grid.keys[i].store(EMPTY_KEY, memory_order_relaxed);
+    grid.blocks = 0;
+    grid.dropped = 0;
+}
+
+// slot of a block, claimed if the block is new
+// return -1 if the block is new and the grid has no block left
+long findBlock(VOXEL_GRID& grid, unsigned long long key)
+{
+    size_t h = (size_t)(((key*0x9E3779B97F4A7C15ull) >> 32) * grid.slots >> 32);
+    for(;; h = h+1<grid.slots ? h+1 : 0)
+    {
+        unsigned long long k = grid.keys[h].load(memory_order_acquire);
+        if(k == key)
+            return (long)h;
+        if(k != EMPTY_KEY)
+            continue;
+
+        // a few claims may pass the limit at once, the extra slots leave room for them
+        if(grid.blocks.load(memory_order_relaxed) >= grid.maxBlocks)
+            return -1;
+        if(grid.keys[h].compare_exchange_strong(k, key, memory_order_acq_rel))
+        {
+            grid.blocks.fetch_add(1, memory_order_relaxed);
+            return (long)h;
+        }
+        // another sensor claimed the slot first, maybe for the same block
+        if(k == key)
+            return (long)h;
+    }
+}
+
+// add the world points of the current frame of a sensor to the grid
+void integrateFrame(VOXEL_GRID& grid, const SENSOR& sensor)
+{
+    const float inv = 1.0f/grid.voxel;
+    const float limit = (float)(1<<(BLOCK_COORD_BITS-1+BLOCK_BITS));
+    const long bias = 1<<(BLOCK_COORD_BITS-1);
+    const long coordMask = (1<<BLOCK_COORD_BITS)-1;
+    unsigned long long lastKey = EMPTY_KEY;
+    long slot = -1;
+    long long dropped = 0;
+
+    for(size_t i=0; i<sensor.worldX.size(); ++i)
+    {
+        float g[3] = {sensor.worldX[i]*inv, sensor.worldY[i]*inv, sensor.worldZ[i]*inv};
+        // pixels without depth are NaN and fail the range check too
+        if(!(fabs(g[0])<limit && fabs(g[1])<limit && fabs(g[2])<limit))
+            continue;
+        long v[3];
+        unsigned int offset[3];
+        for(int k=0; k<3; ++k)
+        {
+            v[k] = (long)floor(g[k]);
+            offset[k] = min((unsigned int)((g[k]-v[k])*VOXEL_STEPS), (unsigned int)VOXEL_STEPS-1);
+        }
+
+        // neighboring pixels mostly fall into the same block, so its slot is looked up once for them
+        unsigned long long key = 0;
+        for(int k=0; k<3; ++k)
+            key = key<<BLOCK_COORD_BITS | (unsigned long long)(((v[k]>>BLOCK_BITS)+bias) & coordMask);
+        if(key != lastKey)
+        {
+            slot = findBlock(grid, key);
+            lastKey = key;
+        }
+        if(slot < 0)
+        {
+            dropped++;
+            continue;
+        }
+
+        const long local = (1<<BLOCK_BITS)-1;
+        VOXEL& voxel = grid.voxels[(size_t)slot*BLOCK_VOXELS + (((v[2]&local)<<BLOCK_BITS | (v[1]&local))<<BLOCK_BITS | (v[0]&local))];
+        // the point is claimed first and handed back over the limit, so no more than VOXEL_MAX_POINTS
+        // points ever reach the sums, however many threads hit a full voxel at once
+        if(voxel.count.fetch_add(1, memory_order_relaxed) >= VOXEL_MAX_POINTS)
+        {
+            voxel.count.fetch_sub(1, memory_order_relaxed);
+            continue;
+        }
+        for(int k=0; k<3; ++k)
+            voxel.sum[k].fetch_add(offset[k], memory_order_relaxed);
+    }
+    if(dropped)
+        grid.dropped.fetch_add(dropped, memory_order_relaxed);
+}
+
+// read the next depth frame of a sensor into its buffer, transform it and add it to the grid
+void processFrame(SENSOR& sensor)
+{
+    if(!sensor.hasFrame)
+        return;
+    size_t pixels = sensor.depth.size();
+    if(fread(sensor.depth.data(), sizeof(unsigned short), pixels, sensor.depthFile) != pixels)
+    {
+        sensor.hasFrame = false;
+        return;
+    }
+    transformFrame(sensor);
+    integrateFrame(grid, sensor);
+    sensor.frames++;
+}
+
+// worker of one sensor, processes every frame handed out by runFrame
+void sensorWorker(FRAME_POOL& pool, SENSOR& sensor)
+{
+    long long seen = 0;
+    while(true)
+    {
+        {
+            unique_lock<mutex> guard(pool.lock);
+            pool.start.wait(guard, [&]() { return pool.stop || pool.frame>seen; });
+            if(pool.stop)
+                return;
+            seen = pool.frame;
+        }
+        processFrame(sensor);
+        {
+            lock_guard<mutex> guard(pool.lock);
+            if(--pool.pending == 0)
+                pool.done.notify_one();
+        }
+    }
+}
+
+void startPool(FRAME_POOL& pool, vector<SENSOR>& sensors)
+{
+    pool.frame = 0;
+    pool.pending = 0;
+    pool.stop = false;
+    for(size_t i=0; i<sensors.size(); ++i)
+        pool.workers.push_back(thread(sensorWorker, ref(pool), ref(sensors[i])));
+}
+
+// process one frame of every sensor in parallel and wait until all of them are done
+void runFrame(FRAME_POOL& pool)
+{
+    unique_lock<mutex> guard(pool.lock);
+    pool.pending = (int)pool.workers.size();
+    pool.frame++;
+    pool.start.notify_all();
+    pool.done.wait(guard, [&]() { return pool.pending == 0; });
+}
+
+void stopPool(FRAME_POOL& pool)
+{
+    {
+        lock_guard<mutex> guard(pool.lock);
+        pool.stop = true;
+    }
+    pool.start.notify_all();
+    for(size_t i=0; i<pool.workers.size(); ++i)
+        pool.workers[i].join();
+    pool.workers.clear();
+}
+
+// write the world points of the last frame of every sensor, "x,y,z" per line like the calibration data
+void writePoints(const vector<SENSOR>& sensors, const string& filepath)
+{
+    ofstream ofs(filepath.c_str(), ios::trunc);
+    for(size_t s=0; s<sensors.size(); ++s)
+    {
+        const SENSOR& sensor = sensors[s];
+        for(size_t i=0; i<sensor.worldX.size(); ++i)
+            if(!isnan(sensor.worldX[i]))
+                ofs << sensor.worldX[i] << "," << sensor.worldY[i] << "," << sensor.worldZ[i] << "\n";
+    }
+}
+
+// write the centroid of every occupied voxel, "x,y,z" per line, return the number of points
+long long writeFusedPoints(const VOXEL_GRID& grid, const string& filepath)
+{
+    ofstream ofs;
+    long long points = 0;
+    const long bias = 1<<(BLOCK_COORD_BITS-1);
+    const unsigned long long coordMask = (1<<BLOCK_COORD_BITS)-1;
+    if(!filepath.empty())
+        ofs.open(filepath.c_str(), ios::trunc);
+    for(size_t s=0; s<grid.slots; ++s)
+    {
+        unsigned long long key = grid.keys[s].load(memory_order_relaxed);
+        if(key == EMPTY_KEY)
+            continue;
+        long block[3];
+        for(int k=2; k>=0; --k, key>>=BLOCK_COORD_BITS)
+            block[k] = (long)(key & coordMask) - bias;
+        for(int i=0; i<BLOCK_VOXELS; ++i)
+        {
+            const VOXEL& voxel = grid.voxels[s*BLOCK_VOXELS+i];
+            unsigned int count = voxel.count.load(memory_order_relaxed);
+            if(count == 0)
+                continue;
+            points++;
+            if(!ofs.is_open())
+                continue;
+            long local[3] = {i & ((1<<BLOCK_BITS)-1), (i>>BLOCK_BITS) & ((1<<BLOCK_BITS)-1), i>>(2*BLOCK_BITS)};
+            float p[3];
+            for(int k=0; k<3; ++k)
+            {
+                double inside = (voxel.sum[k].load(memory_order_relaxed)/(double)count + 0.5) / VOXEL_STEPS;
+                p[k] = (float)((block[k]*(1<<BLOCK_BITS) + local[k] + inside) * grid.voxel);
+            }
+            ofs << p[0] << "," << p[1] << "," << p[2] << "\n";
+        }
+    }
+    return points;
+}
+
+int main(int argc, const char * argv[])
+{
+    vector<SENSOR> sensors;
+    string pointsPath, rawPath;
+    float voxelSize = 0.02f;
+    long maxBlocks = 8192;
+    for(int i=1; i<argc; ++i)
+    {
+        if(strcmp(argv[i], "-size")==0 && i+2<argc)
+        {
+            intrinsics.width = atoi(argv[++i]);
+            intrinsics.height = atoi(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-intrinsics")==0 && i+4<argc)
+        {
+            intrinsics.fx = atof(argv[++i]);
+            intrinsics.fy = atof(argv[++i]);
+            intrinsics.cx = atof(argv[++i]);
+            intrinsics.cy = atof(argv[++i]);
+        }
+        else if(strcmp(argv[i], "-scale")==0 && i+1<argc)
+            intrinsics.scale = atof(argv[++i]);
+        else if(strcmp(argv[i], "-voxel")==0 && i+1<argc)
+            voxelSize = atof(argv[++i]);
+        else if(strcmp(argv[i], "-blocks")==0 && i+1<argc)
+            maxBlocks = atol(argv[++i]);
+        else if(strcmp(argv[i], "-o")==0 && i+1<argc)
+            pointsPath = argv[++i];
+        else if(strcmp(argv[i], "-raw")==0 && i+1<argc)
+            rawPath = argv[++i];
+        else
+        {
+            SENSOR sensor;
+            sensor.name = argv[i];
+            sensors.push_back(sensor);
+        }
+    }
+    if(sensors.empty() || intrinsics.width<=0 || intrinsics.height<=0 || voxelSize<=0 || maxBlocks<=0)
+    {
+        cout << "usage: calibration_point_cloud [-size width height] [-intrinsics fx fy cx cy] [-scale s]" << endl;
+        cout << "       [-voxel size] [-blocks count] [-o points file] [-raw points file] sensor names" << endl;
+        return 1;
+    }
+    initGrid(grid, voxelSize, maxBlocks);
+
+    // load the calibration and open the depth stream of every sensor
+    for(size_t s=0; s<sensors.size(); ++s)
+    {
+        string depthPath = "data/"+sensors[s].name+".depth";
+        if(!loadSensorTransformation(sensors[s]))
+        {
+            cout << "error: can't read the transformation matrix of " << sensors[s].name << endl;
+            return 1;
+        }
+        sensors[s].depthFile = fopen(depthPath.c_str(), "rb");
+        if(sensors[s].depthFile == NULL)
+        {
+            cout << "error: can't open " << depthPath << endl;
+            return 1;
+        }
+        initSensor(sensors[s]);
+    }
+
+    // process frames until every stream has ended
+    FRAME_POOL pool;
+    long long frames = 0;
+    startPool(pool, sensors);
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    while(true)
+    {
+        runFrame(pool);
+        bool any = false;
+        for(size_t s=0; s<sensors.size(); ++s)
+            any = any || sensors[s].hasFrame;
+        if(!any)
+            break;
+        frames++;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now()-begin).count();
+    stopPool(pool);
+
+    long long sensorFrames = 0;
+    for(size_t s=0; s<sensors.size(); ++s)
+    {
+        sensorFrames += sensors[s].frames;
+        fclose(sensors[s].depthFile);
+    }
+    double points = (double)sensorFrames*intrinsics.width*intrinsics.height;
+    cout << "frames: " << frames << ", sensor frames: " << sensorFrames << endl;
+    cout << "frames per second: " << frames/seconds << endl;
+    cout << "points per second: " << points/seconds << endl;
+
+    long long fused = writeFusedPoints(grid, pointsPath);
+    cout << "fused points: " << fused << endl;
+    cout << "blocks: " << grid.blocks << " of " << grid.maxBlocks << ", dropped points: " << grid.dropped << endl;
+    cout << "grid memory: " << grid.slots*(sizeof(unsigned long long)+BLOCK_VOXELS*sizeof(VOXEL))/1048576.0 << " MB" << endl;
+    if(!rawPath.empty())
+        writePoints(sensors, rawPath);
+    return 0;
+}
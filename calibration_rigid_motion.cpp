@@ -17,16 +17,82 @@
 //  output: transformation matrix from camera coordinate to world coordinate
 //  output: position and rotation of Kinect in world coordinate
 //  output: mean squared error for given testing file
+//  output: transformation matrix saved to data/transform_<file name>.yml for calibration_point_cloud.cpp
+//
+//  monitoring mode watches a calibrated Kinect for drift, e.g. after it got bumped
+//  - the tracker streams correspondences to standard input, one "x1,y1,z1;x2,y2,z2" line per point
+//    like the calibration data, optionally followed by ";t" with the time in seconds, a time before
+//    the last one counts as the last one
+//  - the residual of every correspondence, the distance between its transformed camera point and its
+//    world point, goes into a sliding time window split into a fixed number of time slices,
+//    every slice keeps count, sum, sum of squares and maximum, so the window takes constant memory
+//  - when the mean residual of the window passes the threshold, a drift alarm is printed and a refit
+//    is handed to a background thread, so reading the stream never waits for it; the refit is adopted
+//    and saved as soon as it is done
+//  - the refit takes the correspondences since the drift started, the run of last time slices that
+//    pass the threshold, and at least the minimum number of points of the window
+//  - the alarm is cleared when the mean residual gets back under the threshold
+//  input: data/transform_<name>.yml saved by a previous calibration
+//  output: alarms, refits and window statistics, also logged to data/monitor_<name>.txt
+//  command line: -monitor name [-window seconds] [-threshold error] [-min points] [-refit points]
 //
 
 
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "opencv_headers.h"
+#include "calibration_rotation.h"
 
 using namespace std;
 
+// time slices of the sliding window of the monitoring mode
+#define WINDOW_SLICES 16
+
+// residual statistics of one time slice of the window
+typedef struct _residual_slice
+{
+    long long slice;    // number of the time slice, time divided by the slice length
+    long long count;
+    double sum;
+    double sumSq;
+    double max;
+}RESIDUAL_SLICE;
+
+// residual statistics of the whole window
+typedef struct _residual_stats
+{
+    long long count;
+    double mean;
+    double rms;
+    double max;
+}RESIDUAL_STATS;
+
+// refit of the transformation running beside the tracking thread
+typedef struct _refit_job
+{
+    thread worker;
+    mutex lock;
+    condition_variable start;
+    vector<cv::Point3_<float> > cameraPoints;   // correspondences handed to the worker
+    vector<cv::Point3_<float> > worldPoints;
+    cv::Mat rotation;                           // result of the last refit
+    cv::Mat position;
+    bool pending;                               // correspondences waiting for the worker
+    bool stop;
+    atomic<bool> ready;                         // result waiting for the tracking thread
+}REFIT_JOB;
+
 ofstream logFile;
 
 
@@ -230,11 +296,296 @@ void applyTransformation(vector<cv::Point3_<float> >& cameraPoints, vector<cv::P
     return;
 }
 
+// distance between the transformed camera point and the world point of a correspondence
+// same as the error of applyTransformation, without a matrix product per point
+double residual(const cv::Mat& tranMat, const cv::Point3_<float>& cameraPoint, const cv::Point3_<float>& worldPoint)
+{
+    double d[3];
+    const float world[3] = {worldPoint.x, worldPoint.y, worldPoint.z};
+    for(int i=0; i<3; ++i)
+        d[i] = tranMat.at<float>(i,0)*cameraPoint.x + tranMat.at<float>(i,1)*cameraPoint.y
+             + tranMat.at<float>(i,2)*cameraPoint.z + tranMat.at<float>(i,3) - world[i];
+    return sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+}
+
+// add a residual at the given time slice, the slot of a slice that left the window is reused
+void addResidual(RESIDUAL_SLICE* window, long long slice, double error)
+{
+    RESIDUAL_SLICE& s = window[slice%WINDOW_SLICES];
+    if(s.slice != slice)
+    {
+        s.slice = slice;
+        s.count = 0;
+        s.sum = s.sumSq = s.max = 0.0;
+    }
+    s.count++;
+    s.sum += error;
+    s.sumSq += error*error;
+    s.max = max(s.max, error);
+}
+
+// statistics of the slices still in the window that ends with the given slice
+RESIDUAL_STATS windowStats(const RESIDUAL_SLICE* window, long long slice)
+{
+    RESIDUAL_STATS stats = {0, 0.0, 0.0, 0.0};
+    double sum = 0.0, sumSq = 0.0;
+    for(int i=0; i<WINDOW_SLICES; ++i)
+    {
+        if(window[i].slice <= slice-WINDOW_SLICES || window[i].slice > slice)
+            continue;
+        stats.count += window[i].count;
+        sum += window[i].sum;
+        sumSq += window[i].sumSq;
+        stats.max = max(stats.max, window[i].max);
+    }
+    if(stats.count > 0)
+    {
+        stats.mean = sum/stats.count;
+        stats.rms = sqrt(sumSq/stats.count);
+    }
+    return stats;
+}
+
+void clearWindow(RESIDUAL_SLICE* window)
+{
+    for(int i=0; i<WINDOW_SLICES; ++i)
+    {
+        window[i].slice = -1;
+        window[i].count = 0;
+    }
+}
+
+void logStats(const char* event, double time, const RESIDUAL_STATS& stats)
+{
+    cout << event << " at " << time << "s, points: " << stats.count << ", mean error: " << stats.mean
+         << ", rms: " << stats.rms << ", max: " << stats.max << endl;
+    logFile << event << " at " << time << "s, points: " << stats.count << ", mean error: " << stats.mean
+            << ", rms: " << stats.rms << ", max: " << stats.max << endl;
+}
+
+// refit the rotation and position with every batch of correspondences handed over
+void refitWorker(REFIT_JOB* job)
+{
+    vector<cv::Point3_<float> > cameraPoints, worldPoints;
+    cv::Mat rotation, position;
+    while(true)
+    {
+        {
+            unique_lock<mutex> guard(job->lock);
+            job->start.wait(guard, [job]{ return job->pending || job->stop; });
+            if(job->stop)
+                return;
+            cameraPoints.swap(job->cameraPoints);
+            worldPoints.swap(job->worldPoints);
+            job->pending = false;
+        }
+
+        calRotationPosition(cameraPoints, worldPoints, rotation, position);
+
+        lock_guard<mutex> guard(job->lock);
+        job->rotation = rotation.clone();
+        job->position = position.clone();
+        job->ready.store(true, memory_order_release);
+    }
+}
+
+// first time slice of the run of slices up to the given one whose mean residual passes the threshold
+// the correspondences before it still fit the transformation
+long long driftOnset(const RESIDUAL_SLICE* window, long long slice, double threshold)
+{
+    long long first = slice;
+    while(first > 0 && first > slice-WINDOW_SLICES+1)
+    {
+        const RESIDUAL_SLICE& s = window[(first-1)%WINDOW_SLICES];
+        if(s.slice != first-1 || s.count == 0 || s.sum <= threshold*s.count)
+            break;
+        first--;
+    }
+    return first;
+}
+
+// hand the correspondences since the given time, but at least minPoints of them, to the refit worker
+// the ring of the last correspondences is read from the newest one at next-1 backwards
+// the worker takes them by swapping, so the tracking thread holds the lock only while copying
+void startRefit(REFIT_JOB& job, const vector<cv::Point3_<float> >& cameraPoints, const vector<cv::Point3_<float> >& worldPoints,
+                const vector<double>& times, size_t next, double since, size_t minPoints)
+{
+    size_t size = times.size();
+    lock_guard<mutex> guard(job.lock);
+    job.cameraPoints.clear();
+    job.worldPoints.clear();
+    for(size_t k=1; k<=size; ++k)
+    {
+        size_t i = (next+size-k)%size;
+        if(times[i] == -HUGE_VAL || (times[i] < since && k > minPoints))
+            break;
+        job.cameraPoints.push_back(cameraPoints[i]);
+        job.worldPoints.push_back(worldPoints[i]);
+    }
+    job.pending = true;
+    job.start.notify_one();
+}
+
+// watch the residuals of the correspondences streamed to standard input
+// return the exit code of the program
+int monitor(int argc, const char * argv[])
+{
+    string name;
+    double window = 10.0;
+    double threshold = 0.05;
+    long long minPoints = 50;
+    size_t refitPoints = 1000;
+    for(int i=1; i<argc; ++i)
+    {
+        if(strcmp(argv[i], "-monitor")==0 && i+1<argc)
+            name = argv[++i];
+        else if(strcmp(argv[i], "-window")==0 && i+1<argc)
+            window = atof(argv[++i]);
+        else if(strcmp(argv[i], "-threshold")==0 && i+1<argc)
+            threshold = atof(argv[++i]);
+        else if(strcmp(argv[i], "-min")==0 && i+1<argc)
+            minPoints = atoll(argv[++i]);
+        else if(strcmp(argv[i], "-refit")==0 && i+1<argc)
+            refitPoints = (size_t)atol(argv[++i]);
+    }
+    if(name.empty() || window<=0 || minPoints<3 || refitPoints<3)
+    {
+        cout << "usage: calibration_rigid_motion -monitor name [-window seconds] [-threshold error] [-min points] [-refit points]" << endl;
+        return 1;
+    }
+
+    cv::Mat tranMat;
+    if(!loadTransformation(tranMat, name))
+    {
+        cout << "no transformation saved for " << name << ", calibrate it first" << endl;
+        return 1;
+    }
+    string filepath = "data/monitor_"+name+".txt";
+    logFile.open(filepath.c_str(), ios::trunc);
+
+    // the last correspondences, the refit takes the ones inside the window
+    vector<cv::Point3_<float> > cameraPoints(refitPoints), worldPoints(refitPoints);
+    vector<double> times(refitPoints, -HUGE_VAL);
+    size_t next = 0;
+
+    RESIDUAL_SLICE slices[WINDOW_SLICES];
+    clearWindow(slices);
+    double sliceLength = window/WINDOW_SLICES;
+    double now = 0.0;
+    long long points = 0, alarms = 0, refits = 0;
+    bool alarm = false, refitting = false;
+
+    REFIT_JOB job;
+    job.pending = false;
+    job.stop = false;
+    job.ready = false;
+    job.worker = thread(refitWorker, &job);
+
+    // times are counted from the first correspondence
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    double firstTime = 0.0;
+    string str;
+    while(getline(cin, str))
+    {
+        float a, b, c, d, e, f;
+        double t;
+        int fields = sscanf(str.c_str(), "%f,%f,%f;%f,%f,%f;%lf", &a, &b, &c, &d, &e, &f, &t);
+        if(fields < 6)
+            continue;
+        if(fields == 7)
+        {
+            if(points == 0)
+                firstTime = t;
+            // a timestamp going backwards stays at the last time, an older slice would reset the slot
+            // of a newer one that shares it
+            now = max(t-firstTime, now);
+        }
+        else
+            now = chrono::duration<double>(chrono::steady_clock::now()-begin).count();
+        long long slice = (long long)floor(now/sliceLength);
+
+        // adopt a finished refit, the residuals of the old transformation don't count any more
+        if(job.ready.load(memory_order_acquire))
+        {
+            cv::Mat rotation, position;
+            {
+                lock_guard<mutex> guard(job.lock);
+                rotation = job.rotation;
+                position = job.position;
+                job.ready.store(false, memory_order_relaxed);
+            }
+            refitting = false;
+            alarm = false;
+            refits++;
+            cout << "refit at " << now << "s" << endl;
+            logFile << "refit at " << now << "s" << endl;
+            decomposeRotation(rotation);
+            calTransformationMatrix(rotation, position, tranMat);
+            saveTransformation(tranMat, name);
+            clearWindow(slices);
+        }
+
+        cameraPoints[next] = cv::Point3_<float>(a,b,c);
+        worldPoints[next] = cv::Point3_<float>(d,e,f);
+        times[next] = now;
+        addResidual(slices, slice, residual(tranMat, cameraPoints[next], worldPoints[next]));
+        next = (next+1)%refitPoints;
+        points++;
+
+        RESIDUAL_STATS stats = windowStats(slices, slice);
+        if(stats.count < minPoints)
+            continue;
+        if(!alarm && stats.mean > threshold)
+        {
+            alarm = true;
+            alarms++;
+            logStats("drift alarm", now, stats);
+            if(!refitting)
+            {
+                refitting = true;
+                startRefit(job, cameraPoints, worldPoints, times, next, driftOnset(slices, slice, threshold)*sliceLength, (size_t)minPoints);
+            }
+        }
+        else if(alarm && stats.mean <= threshold)
+        {
+            alarm = false;
+            logStats("drift cleared", now, stats);
+        }
+    }
+
+    {
+        lock_guard<mutex> guard(job.lock);
+        job.stop = true;
+        job.start.notify_one();
+    }
+    job.worker.join();
+    if(job.ready)
+    {
+        refits++;
+        cout << "refit at end of stream" << endl;
+        logFile << "refit at end of stream" << endl;
+        decomposeRotation(job.rotation);
+        calTransformationMatrix(job.rotation, job.position, tranMat);
+        saveTransformation(tranMat, name);
+    }
+
+    long long slice = (long long)floor(now/sliceLength);
+    logStats("end of stream", now, windowStats(slices, slice));
+    cout << "points: " << points << ", alarms: " << alarms << ", refits: " << refits << endl;
+    logFile << "points: " << points << ", alarms: " << alarms << ", refits: " << refits << endl;
+    logFile.close();
+    return 0;
+}
+
 // input: points set data file name
 // output: rotation and position of camera
 // output: transformation matrix from camera coordinate to world coordinate
-int main()
+// with -monitor: watch the calibration of a Kinect for drift, see the top of the file
+int main(int argc, const char * argv[])
 {
+    if(argc > 1)
+        return monitor(argc, argv);
+
     while(true)
     {
         // get input file name
@@ -269,6 +620,9 @@ int main()
         // calculate transformation matrix from rotation and position
         calTransformationMatrix(cameraRotation, cameraPosition, tranMat);
 
+        // save transformation matrix for calibration_point_cloud.cpp
+        saveTransformation(tranMat, fileName);
+
         // get testing file
         string testFileName;
         cout << "testing file name (press enter to exit): ";
@@ -0,0 +1,327 @@
+//
+//  calibration_rotation.h
+//  Algorithm
+//
+//  shared rotation handling for the calibration programs (calibration_least_squares.cpp,
+//  calibration_compare.cpp, calibration_consensus.cpp), and the loading and saving of the
+//  data/transform_<name>.yml files, which calibration_rigid_motion.cpp and calibration_point_cloud.cpp share
+//
+//  - projectRotation finds the rotation nearest to a matrix by polar decomposition: for the SVD
+//    A = U*W*Vt of its 3x3 block the rotation is U*diag(1,1,det(U*Vt))*Vt, so the affine result of the
+//    least squares method can be decomposed into angles like a rigid motion
+//  - a batch keeps many rotations as structure of arrays, one array per matrix element, so the
+//    conversions to Euler angles and quaternions are plain loops without branches that the compiler
+//    vectorizes, compile with -O3 -fno-math-errno -fno-trapping-math so it can use vector square
+//    roots and selects
+//  - repeated calibrations of one sensor are averaged into one consensus rotation, either the chordal
+//    mean, the rotation nearest to the mean matrix, or the chordal median by Weiszfeld iterations,
+//    which keeps a few bad calibrations from pulling the result away
+//  Euler angles are the ones of decomposeRotation, radians around x, y and z
+//
+
+#ifndef CALIBRATION_ROTATION_H
+#define CALIBRATION_ROTATION_H
+
+#include <vector>
+#include <string>
+#include <math.h>
+#include "opencv_headers.h"
+
+// rotations of a batch, element (i,j) of every rotation is in m[i*3+j]
+typedef struct _rotation_batch
+{
+    std::vector<float> m[9];
+}ROTATION_BATCH;
+
+// rotation nearest to the 3x3 block of a matrix, return the Frobenius distance between them
+// the distance is 0 for a rotation and grows with the scale and shear of an affine matrix
+inline double projectRotation(const cv::Mat& matrix, cv::Mat& rotation)
+{
+    cv::Mat block = cv::Mat(3, 3, CV_32F);
+    for(int i=0; i<3; ++i)
+        for(int j=0; j<3; ++j)
+            block.at<float>(i,j) = matrix.at<float>(i,j);
+
+    cv::Mat w;      // calculated singular values
+    cv::Mat u;      // calculated left singular vectors
+    cv::Mat vt;     // transposed matrix of right singular values
+    cv::SVD::compute(block, w, u, vt);
+
+    // a reflection is turned into a rotation by flipping the axis of the smallest singular value
+    cv::Mat tempMat = cv::Mat::zeros(3,3,CV_32F);
+    tempMat.at<float>(0,0) = 1;
+    tempMat.at<float>(1,1) = 1;
+    tempMat.at<float>(2,2) = cv::determinant(u*vt) < 0 ? -1 : 1;
+    rotation = u*tempMat*vt;
+
+    double distance = 0.0;
+    for(int i=0; i<3; ++i)
+        for(int j=0; j<3; ++j)
+            distance += pow(block.at<float>(i,j)-rotation.at<float>(i,j), 2);
+    return sqrt(distance);
+}
+
+inline void addRotation(ROTATION_BATCH& batch, const cv::Mat& rotation)
+{
+    for(int i=0; i<3; ++i)
+        for(int j=0; j<3; ++j)
+            batch.m[i*3+j].push_back(rotation.at<float>(i,j));
+}
+
+inline size_t batchSize(const ROTATION_BATCH& batch)
+{
+    return batch.m[0].size();
+}
+
+inline void getRotation(const ROTATION_BATCH& batch, size_t index, cv::Mat& rotation)
+{
+    rotation = cv::Mat(3, 3, CV_32F);
+    for(int i=0; i<3; ++i)
+        for(int j=0; j<3; ++j)
+            rotation.at<float>(i,j) = batch.m[i*3+j][index];
+}
+
+// atan2 without branches, so loops calling it get vectorized
+// polynomial of atan on [0,1], the error is about 2e-6 radians
+inline float batchAtan2(float y, float x)
+{
+    float ax = fabsf(x);
+    float ay = fabsf(y);
+    float lo = ax < ay ? ax : ay;
+    float hi = ax < ay ? ay : ax;
+    float a = lo / (hi > 1e-30f ? hi : 1e-30f);
+    float s = a*a;
+    float r = (((((-0.01172120f*s + 0.05265332f)*s - 0.11643287f)*s + 0.19354346f)*s - 0.33262347f)*s + 0.99997726f)*a;
+    r = ay > ax ? 1.57079633f-r : r;
+    r = x < 0 ? 3.14159265f-r : r;
+    return copysignf(r, y);
+}
+
+// loops of the batch conversions, the arrays are restrict parameters so the compiler doesn't need
+// run-time overlap checks between them, with this many arrays it would rather not vectorize
+inline void eulerLoop(size_t n, const float* __restrict m00, const float* __restrict m10, const float* __restrict m20,
+                      const float* __restrict m21, const float* __restrict m22, float* __restrict x, float* __restrict y, float* __restrict z)
+{
+    for(size_t i=0; i<n; ++i)
+    {
+        x[i] = batchAtan2(m21[i], m22[i]);
+        y[i] = batchAtan2(-m20[i], sqrtf(m21[i]*m21[i] + m22[i]*m22[i]));
+        z[i] = batchAtan2(m10[i], m00[i]);
+    }
+}
+
+inline void quaternionLoop(size_t n, const float* __restrict const* m, float* __restrict w, float* __restrict x, float* __restrict y, float* __restrict z)
+{
+    const float* __restrict m00 = m[0];
+    const float* __restrict m01 = m[1];
+    const float* __restrict m02 = m[2];
+    const float* __restrict m10 = m[3];
+    const float* __restrict m11 = m[4];
+    const float* __restrict m12 = m[5];
+    const float* __restrict m20 = m[6];
+    const float* __restrict m21 = m[7];
+    const float* __restrict m22 = m[8];
+    for(size_t i=0; i<n; ++i)
+    {
+        float sw = 1.0f + m00[i] + m11[i] + m22[i];
+        float sx = 1.0f + m00[i] - m11[i] - m22[i];
+        float sy = 1.0f - m00[i] + m11[i] - m22[i];
+        float sz = 1.0f - m00[i] - m11[i] + m22[i];
+        float qw = 0.5f*sqrtf(sw > 0 ? sw : 0);
+        float qx = 0.5f*sqrtf(sx > 0 ? sx : 0);
+        float qy = 0.5f*sqrtf(sy > 0 ? sy : 0);
+        float qz = 0.5f*sqrtf(sz > 0 ? sz : 0);
+
+        // the differences are 4w times x, y and z, the sums 4xy, 4xz and 4yz, so every sign is taken
+        // from the product with the largest component, near 180 degrees w and its differences vanish
+        float dx = m21[i]-m12[i], dy = m02[i]-m20[i], dz = m10[i]-m01[i];
+        float pxy = m10[i]+m01[i], pxz = m02[i]+m20[i], pyz = m21[i]+m12[i];
+        // & instead of && so the comparisons don't branch
+        bool wMax = (qw >= qx) & (qw >= qy) & (qw >= qz);
+        bool xMax = !wMax & (qx >= qy) & (qx >= qz);
+        bool yMax = !wMax & !xMax & (qy >= qz);
+        float signW = wMax ? 1.0f : (xMax ? dx : (yMax ? dy : dz));
+        float signX = wMax ? dx : (xMax ? 1.0f : (yMax ? pxy : pxz));
+        float signY = wMax ? dy : (xMax ? pxy : (yMax ? 1.0f : pyz));
+        float signZ = wMax ? dz : (xMax ? pxz : (yMax ? pyz : 1.0f));
+
+        // q and -q are the same rotation, flip the signs relative to the largest one so that w>=0
+        float flip = signW < 0 ? -1.0f : 1.0f;
+        w[i] = qw;
+        x[i] = copysignf(qx, signX*flip);
+        y[i] = copysignf(qy, signY*flip);
+        z[i] = copysignf(qz, signZ*flip);
+    }
+}
+
+// Euler angles of every rotation of a batch, same angles as decomposeRotation
+inline void batchEuler(const ROTATION_BATCH& batch, std::vector<float>& radX, std::vector<float>& radY, std::vector<float>& radZ)
+{
+    size_t n = batchSize(batch);
+    radX.resize(n);
+    radY.resize(n);
+    radZ.resize(n);
+    eulerLoop(n, batch.m[0].data(), batch.m[3].data(), batch.m[6].data(), batch.m[7].data(), batch.m[8].data(),
+              radX.data(), radY.data(), radZ.data());
+}
+
+// unit quaternions (w,x,y,z) of every rotation of a batch, with w>=0
+// every component comes from the diagonal, the off-diagonal elements only give the signs relative
+// to the largest component, so a component close to 0 is only good to about 1e-4
+inline void batchQuaternions(const ROTATION_BATCH& batch, std::vector<float>& qw, std::vector<float>& qx, std::vector<float>& qy, std::vector<float>& qz)
+{
+    size_t n = batchSize(batch);
+    qw.resize(n);
+    qx.resize(n);
+    qy.resize(n);
+    qz.resize(n);
+    const float* m[9];
+    for(int k=0; k<9; ++k)
+        m[k] = batch.m[k].data();
+    quaternionLoop(n, m, qw.data(), qx.data(), qy.data(), qz.data());
+}
+
+// angle in radians of the rotation between two rotations
+inline double rotationAngle(const cv::Mat& a, const cv::Mat& b)
+{
+    double trace = 0.0;
+    for(int i=0; i<3; ++i)
+        for(int j=0; j<3; ++j)
+            trace += a.at<float>(i,j)*b.at<float>(i,j);
+    double c = (trace-1.0)/2.0;
+    return acos(c > 1.0 ? 1.0 : (c < -1.0 ? -1.0 : c));
+}
+
+// chordal L2 mean, the rotation nearest to the mean of the matrices of a batch
+inline void chordalMean(const ROTATION_BATCH& batch, cv::Mat& rotation)
+{
+    size_t n = batchSize(batch);
+    cv::Mat sum = cv::Mat::zeros(3,3,CV_32F);
+    for(int k=0; k<9; ++k)
+    {
+        double s = 0.0;
+        for(size_t i=0; i<n; ++i)
+            s += batch.m[k][i];
+        sum.at<float>(k/3,k%3) = s/n;
+    }
+    projectRotation(sum, rotation);
+}
+
+// chordal L1 median of a batch by Weiszfeld iterations from the mean matrix
+// every iteration weights the rotations by the inverse of their distance to the current median,
+// the median is then projected onto the rotations; return the number of iterations
+inline int chordalMedian(const ROTATION_BATCH& batch, cv::Mat& rotation, int maxIterations = 100)
+{
+    size_t n = batchSize(batch);
+    double median[9], next[9];
+    for(int k=0; k<9; ++k)
+    {
+        median[k] = 0.0;
+        for(size_t i=0; i<n; ++i)
+            median[k] += batch.m[k][i];
+        median[k] /= n;
+    }
+
+    int iteration = 0;
+    while(iteration < maxIterations)
+    {
+        iteration++;
+        double weights = 0.0;
+        for(int k=0; k<9; ++k)
+            next[k] = 0.0;
+        for(size_t i=0; i<n; ++i)
+        {
+            double distance = 0.0;
+            for(int k=0; k<9; ++k)
+                distance += (batch.m[k][i]-median[k])*(batch.m[k][i]-median[k]);
+            // a rotation right at the median would get an infinite weight
+            double w = 1.0/(sqrt(distance) > 1e-9 ? sqrt(distance) : 1e-9);
+            weights += w;
+            for(int k=0; k<9; ++k)
+                next[k] += w*batch.m[k][i];
+        }
+        double change = 0.0;
+        for(int k=0; k<9; ++k)
+        {
+            next[k] /= weights;
+            change += (next[k]-median[k])*(next[k]-median[k]);
+            median[k] = next[k];
+        }
+        if(change < 1e-14)
+            break;
+    }
+
+    cv::Mat medianMat = cv::Mat(3, 3, CV_32F);
+    for(int k=0; k<9; ++k)
+        medianMat.at<float>(k/3,k%3) = median[k];
+    projectRotation(medianMat, rotation);
+    return iteration;
+}
+
+// geometric median of positions by Weiszfeld iterations, return the number of iterations
+inline int positionMedian(const std::vector<cv::Point3_<float> >& positions, cv::Point3_<float>& median, int maxIterations = 100)
+{
+    size_t n = positions.size();
+    double m[3] = {0.0, 0.0, 0.0};
+    for(size_t i=0; i<n; ++i)
+    {
+        m[0] += positions[i].x/n;
+        m[1] += positions[i].y/n;
+        m[2] += positions[i].z/n;
+    }
+
+    int iteration = 0;
+    while(iteration < maxIterations)
+    {
+        iteration++;
+        double weights = 0.0, next[3] = {0.0, 0.0, 0.0};
+        for(size_t i=0; i<n; ++i)
+        {
+            double p[3] = {positions[i].x, positions[i].y, positions[i].z};
+            double distance = sqrt((p[0]-m[0])*(p[0]-m[0]) + (p[1]-m[1])*(p[1]-m[1]) + (p[2]-m[2])*(p[2]-m[2]));
+            double w = 1.0/(distance > 1e-9 ? distance : 1e-9);
+            weights += w;
+            for(int k=0; k<3; ++k)
+                next[k] += w*p[k];
+        }
+        double change = 0.0;
+        for(int k=0; k<3; ++k)
+        {
+            next[k] /= weights;
+            change += (next[k]-m[k])*(next[k]-m[k]);
+            m[k] = next[k];
+        }
+        if(change < 1e-14)
+            break;
+    }
+    median = cv::Point3_<float>(m[0], m[1], m[2]);
+    return iteration;
+}
+
+// save the transformation matrix as data/transform_<name>.yml
+// the name of the calibration data file names the sensor for calibration_point_cloud.cpp
+inline void saveTransformation(const cv::Mat& tranMat, const std::string& filename)
+{
+    std::string filepath = "data/transform_"+filename+".yml";
+    cv::FileStorage fs(filepath, cv::FileStorage::WRITE);
+    fs << "transformation" << tranMat;
+    fs.release();
+}
+
+// load the transformation matrix saved by a calibration
+// only the first 3 rows are used, so a matrix without the last 0 0 0 1 row is accepted too
+inline bool loadTransformation(cv::Mat& tranMat, const std::string& filename)
+{
+    std::string filepath = "data/transform_"+filename+".yml";
+    cv::FileStorage fs(filepath, cv::FileStorage::READ);
+    if(!fs.isOpened())
+        return false;
+    fs["transformation"] >> tranMat;
+    fs.release();
+    if(tranMat.rows < 3 || tranMat.cols != 4)
+        return false;
+    tranMat.convertTo(tranMat, CV_32F);
+    return true;
+}
+
+#endif
@@ -0,0 +1,483 @@
+//
+//  dynamic_mst.cpp
+//  Algorithm
+//
+//  Maintained a minimum spanning forest under edge insertions, deletions and weight changes
+//  with a link-cut tree, instead of recomputing the tree from scratch after every change.
+//
+//  every tree edge is a node of the link-cut tree placed between its two vertices,
+//  so the heaviest edge on a tree path is a path aggregate
+//  - insert or decrease: if the endpoints are already connected, the edge replaces the heaviest
+//    edge on the tree path between them when it is lighter, otherwise it links two trees, O(log n)
+//  - delete or increase of a tree edge: the edge is cut and the lightest non-tree edge between
+//    the two trees reconnects them; every vertex keeps the ids of its tree edges and its non-tree
+//    edges ordered by weight, the two trees are searched from the endpoints of the cut edge in turns,
+//    one tree edge at a time, so the smaller tree is known after O(s) steps for s vertices in it,
+//    and only the non-tree edges at its vertices are tried, each vertex stopping at its first
+//    crossing edge or at the lightest crossing edge found so far, O(s + d log n) for d tried
+//  - delete or increase of a non-tree edge only touches the sets of its endpoints, O(log n)
+//
+//  input: a graph in any format read by mst_common.h, followed by "q" and q operations "op a b w"
+//  op 0 sets the weight of edge (a,b) to w and inserts the edge if it doesn't exist
+//  op 1 deletes edge (a,b), w is ignored
+//  output: weight of the minimum spanning forest after the graph and after every operation
+//
+
+#include <cstdio>
+#include <climits>
+#include <vector>
+#include <set>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include "mst_common.h"
+
+// link-cut tree node, vertices first and then one node per edge
+typedef struct _lct_node
+{
+    int ch[2];
+    int parent;
+    int weight;
+    int maxnode;    // node of the largest weight in the splay subtree
+    bool rev;
+}LCT_NODE;
+
+typedef struct _dyn_edge
+{
+    int a;
+    int b;
+    int dis;
+    bool tree;
+}DYN_EDGE;
+
+int n;
+long long ret;
+std::vector<LCT_NODE> lct;
+std::vector<DYN_EDGE> elist;
+std::vector<int> freeEdges;
+std::map<std::pair<int, int>, int> edgeIndex;
+// ids of the tree edges and (weight, edge id) of the non-tree edges at every vertex
+std::vector<std::set<int> > treeAdj;
+std::vector<std::set<std::pair<int, int> > > nonTreeAdj;
+// vertices reached by the two searches of findReplacement, marked with the number of the search
+std::vector<int> visited[2];
+int searchStamp;
+
+// ---- link-cut tree ----
+
+void newNode(int weight)
+{
+    LCT_NODE node;
+    node.ch[0] = node.ch[1] = node.parent = -1;
+    node.weight = weight;
+    node.maxnode = (int)lct.size();
+    node.rev = false;
+    lct.push_back(node);
+}
+
+bool isRoot(int x)
+{
+    int p = lct[x].parent;
+    return p==-1 || (lct[p].ch[0]!=x && lct[p].ch[1]!=x);
+}
+
+void pushUp(int x)
+{
+    lct[x].maxnode = x;
+    for(int i=0; i<2; ++i)
+    {
+        int c = lct[x].ch[i];
+        if(c!=-1 && lct[lct[c].maxnode].weight > lct[lct[x].maxnode].weight)
+            lct[x].maxnode = lct[c].maxnode;
+    }
+}
+
+void toggle(int x)
+{
+    std::swap(lct[x].ch[0], lct[x].ch[1]);
+    lct[x].rev = !lct[x].rev;
+}
+
+void pushDown(int x)
+{
+    if(lct[x].rev)
+    {
+        if(lct[x].ch[0] != -1)
+            toggle(lct[x].ch[0]);
+        if(lct[x].ch[1] != -1)
+            toggle(lct[x].ch[1]);
+        lct[x].rev = false;
+    }
+}
+
+void rotate(int x)
+{
+    int y = lct[x].parent;
+    int z = lct[y].parent;
+    int dx = lct[y].ch[1]==x;
+    if(!isRoot(y))
+        lct[z].ch[lct[z].ch[1]==y] = x;
+    lct[x].parent = z;
+    lct[y].ch[dx] = lct[x].ch[!dx];
+    if(lct[x].ch[!dx] != -1)
+        lct[lct[x].ch[!dx]].parent = y;
+    lct[x].ch[!dx] = y;
+    lct[y].parent = x;
+    pushUp(y);
+    pushUp(x);
+}
+
+void splay(int x)
+{
+    // push down pending reversals from the splay root
+    static std::vector<int> path;
+    path.clear();
+    for(int y=x; ; y=lct[y].parent)
+    {
+        path.push_back(y);
+        if(isRoot(y))
+            break;
+    }
+    for(int i=(int)path.size()-1; i>=0; --i)
+        pushDown(path[i]);
+
+    while(!isRoot(x))
+    {
+        int y = lct[x].parent;
+        if(!isRoot(y))
+        {
+            int z = lct[y].parent;
+            rotate(((lct[y].ch[0]==x) != (lct[z].ch[0]==y)) ? x : y);
+        }
+        rotate(x);
+    }
+}
+
+void access(int x)
+{
+    for(int last=-1, y=x; y!=-1; last=y, y=lct[y].parent)
+    {
+        splay(y);
+        lct[y].ch[1] = last;
+        pushUp(y);
+    }
+    splay(x);
+}
+
+void makeRoot(int x)
+{
+    access(x);
+    toggle(x);
+}
+
+int findRoot(int x)
+{
+    access(x);
+    while(pushDown(x), lct[x].ch[0] != -1)
+        x = lct[x].ch[0];
+    splay(x);
+    return x;
+}
+
+bool connected(int a, int b)
+{
+    return a==b || findRoot(a)==findRoot(b);
+}
+
+void link(int x, int y)
+{
+    makeRoot(x);
+    lct[x].parent = y;
+}
+
+// x and y must be adjacent in the tree
+void cut(int x, int y)
+{
+    makeRoot(x);
+    access(y);
+    lct[y].ch[0] = -1;
+    lct[x].parent = -1;
+    pushUp(y);
+}
+
+// node of the heaviest edge on the tree path between a and b
+int pathMax(int a, int b)
+{
+    makeRoot(a);
+    access(b);
+    return lct[b].maxnode;
+}
+
+// ---- spanning forest maintenance ----
+
+int otherEnd(int e, int v)
+{
+    return elist[e].a==v ? elist[e].b : elist[e].a;
+}
+
+void addNonTreeEdge(int e)
+{
+    nonTreeAdj[elist[e].a].insert(std::make_pair(elist[e].dis, e));
+    nonTreeAdj[elist[e].b].insert(std::make_pair(elist[e].dis, e));
+}
+
+void removeNonTreeEdge(int e)
+{
+    nonTreeAdj[elist[e].a].erase(std::make_pair(elist[e].dis, e));
+    nonTreeAdj[elist[e].b].erase(std::make_pair(elist[e].dis, e));
+}
+
+void addTreeEdge(int e)
+{
+    int x = n+e;
+    access(x);
+    lct[x].weight = elist[e].dis;
+    pushUp(x);
+    link(elist[e].a, x);
+    link(x, elist[e].b);
+    elist[e].tree = true;
+    treeAdj[elist[e].a].insert(e);
+    treeAdj[elist[e].b].insert(e);
+    ret += elist[e].dis;
+}
+
+void removeTreeEdge(int e)
+{
+    cut(elist[e].a, n+e);
+    cut(n+e, elist[e].b);
+    elist[e].tree = false;
+    treeAdj[elist[e].a].erase(e);
+    treeAdj[elist[e].b].erase(e);
+    ret -= elist[e].dis;
+}
+
+// put edge e, which is not in the forest yet, into the forest or the non-tree set
+void insertEdge(int e)
+{
+    int a = elist[e].a;
+    int b = elist[e].b;
+    if(!connected(a, b))
+    {
+        addTreeEdge(e);
+        return;
+    }
+    int m = pathMax(a, b);
+    if(m>=n && lct[m].weight > elist[e].dis)
+    {
+        int old = m-n;
+        removeTreeEdge(old);
+        addNonTreeEdge(old);
+        addTreeEdge(e);
+    }
+    else
+        addNonTreeEdge(e);
+}
+
+// reconnect the two trees left after cutting the tree edge (a,b) with the lightest crossing non-tree edge
+// a crossing edge has one endpoint in each tree, so it is enough to look at the edges of the smaller one
+void findReplacement(int a, int b)
+{
+    typedef std::pair<int, std::set<int>::iterator> VISIT;
+    static std::vector<VISIT> stack[2];
+    static std::vector<int> members[2];
+    int roots[2] = {a, b};
+    int small = -1;
+    searchStamp++;
+    for(int t=0; t<2; ++t)
+    {
+        stack[t].clear();
+        members[t].clear();
+        visited[t][roots[t]] = searchStamp;
+        members[t].push_back(roots[t]);
+        stack[t].push_back(VISIT(roots[t], treeAdj[roots[t]].begin()));
+    }
+
+    // one tree edge per search and turn, the first search to run out has the smaller tree
+    while(small == -1)
+    {
+        for(int t=0; t<2 && small==-1; ++t)
+        {
+            if(stack[t].empty())
+            {
+                small = t;
+                break;
+            }
+            VISIT& top = stack[t].back();
+            if(top.second == treeAdj[top.first].end())
+            {
+                stack[t].pop_back();
+                continue;
+            }
+            int u = otherEnd(*top.second, top.first);
+            ++top.second;
+            if(visited[t][u] != searchStamp)
+            {
+                visited[t][u] = searchStamp;
+                members[t].push_back(u);
+                stack[t].push_back(VISIT(u, treeAdj[u].begin()));
+            }
+        }
+    }
+
+    // lightest edge leaving the smaller tree, every vertex stops at its first crossing edge
+    std::pair<int, int> best(INT_MAX, -1);
+    for(size_t i=0; i<members[small].size(); ++i)
+    {
+        int v = members[small][i];
+        std::set<std::pair<int, int> >::iterator it;
+        for(it=nonTreeAdj[v].begin(); it!=nonTreeAdj[v].end() && *it<best; ++it)
+        {
+            if(visited[small][otherEnd(it->second, v)] != searchStamp)
+            {
+                best = *it;
+                break;
+            }
+        }
+    }
+    if(best.second != -1)
+    {
+        removeNonTreeEdge(best.second);
+        addTreeEdge(best.second);
+    }
+}
+
+// set the weight of edge (a,b), or only lower it when lighter is set
+// lighter is used while loading the graph, where parallel edges keep the lightest weight
+void setEdge(int a, int b, int w, bool lighter)
+{
+    if(a<0 || a>=n || b<0 || b>=n || a==b)
+        return;
+    std::pair<int, int> key(std::min(a, b), std::max(a, b));
+    std::map<std::pair<int, int>, int>::iterator it = edgeIndex.find(key);
+    int e;
+
+    // new edge
+    if(it == edgeIndex.end())
+    {
+        if(freeEdges.empty())
+        {
+            e = (int)elist.size();
+            elist.push_back(DYN_EDGE());
+            newNode(INT_MIN);
+        }
+        else
+        {
+            e = freeEdges.back();
+            freeEdges.pop_back();
+        }
+        elist[e].a = a;
+        elist[e].b = b;
+        elist[e].dis = w;
+        elist[e].tree = false;
+        edgeIndex[key] = e;
+        insertEdge(e);
+        return;
+    }
+
+    e = it->second;
+    if(lighter && w >= elist[e].dis)
+        return;
+    if(elist[e].tree)
+    {
+        // a lighter tree edge keeps the forest minimal
+        if(w <= elist[e].dis)
+        {
+            access(n+e);
+            lct[n+e].weight = w;
+            pushUp(n+e);
+            ret += w-elist[e].dis;
+            elist[e].dis = w;
+        }
+        // a heavier one competes with the edges crossing its cut, itself included
+        else
+        {
+            removeTreeEdge(e);
+            elist[e].dis = w;
+            addNonTreeEdge(e);
+            findReplacement(elist[e].a, elist[e].b);
+        }
+    }
+    else
+    {
+        removeNonTreeEdge(e);
+        elist[e].dis = w;
+        insertEdge(e);
+    }
+}
+
+void deleteEdge(int a, int b)
+{
+    std::pair<int, int> key(std::min(a, b), std::max(a, b));
+    std::map<std::pair<int, int>, int>::iterator it = edgeIndex.find(key);
+    if(it == edgeIndex.end())
+        return;
+    int e = it->second;
+    edgeIndex.erase(it);
+    freeEdges.push_back(e);
+    if(elist[e].tree)
+    {
+        removeTreeEdge(e);
+        findReplacement(elist[e].a, elist[e].b);
+    }
+    else
+        removeNonTreeEdge(e);
+}
+
+void reset(int vertices)
+{
+    n = vertices;
+    ret = 0;
+    lct.clear();
+    elist.clear();
+    freeEdges.clear();
+    edgeIndex.clear();
+    treeAdj.assign(n, std::set<int>());
+    nonTreeAdj.assign(n, std::set<std::pair<int, int> >());
+    visited[0].assign(n, 0);
+    visited[1].assign(n, 0);
+    searchStamp = 0;
+    for(int i=0; i<n; ++i)
+        newNode(INT_MIN);
+}
+
+int main(int argc, const char * argv[])
+{
+    int i, j, q, op, a, b, w;
+    GRAPH_OPTIONS opts;
+    GRAPH_INPUT in;
+    GRAPH_INSTANCE g;
+    parseGraphOptions(argc, argv, opts);
+    if(!openGraphInput(opts, in))
+        return 1;
+    while(nextGraphInstance(in, g))
+    {
+        reset(g.n);
+        if(in.layout == LAYOUT_MATRIX)
+        {
+            for(i=0; i<n; i++)
+                for(j=i+1; j<n; j++)
+                    setEdge(i, j, g.data[(size_t)i*n+j], true);
+        }
+        else
+        {
+            for(i=0; i<g.m; i++)
+                setEdge(g.data[3*i], g.data[3*i+1], g.data[3*i+2], true);
+        }
+        printf("%lld\n", ret);
+
+        if(!nextGraphInt(in, q))
+            break;
+        for(i=0; i<q; i++)
+        {
+            if(!nextGraphInt(in, op) || !nextGraphInt(in, a) || !nextGraphInt(in, b) || !nextGraphInt(in, w))
+                break;
+            if(op == 0)
+                setEdge(a, b, w, false);
+            else
+                deleteEdge(a, b);
+            printf("%lld\n", ret);
+        }
+    }
+    closeGraphInput(in);
+    return 0;
+}
@@ -0,0 +1,424 @@
+//
+//  euclidean_mst.cpp
+//  Algorithm
+//
+//  Implemented Euclidean minimum spanning tree of a point set, where the weight of every edge
+//  is the distance between its two points, without materializing the n*n distance matrix.
+//
+//  - low dimensions: dual-tree Boruvka on a k-d tree
+//    every round finds, for every component, the nearest point outside of it by traversing pairs
+//    of tree nodes, and skips a pair when both nodes lie in one component or when the nodes are
+//    farther apart than the best candidate of every point in the query node
+//  - high dimensions, where k-d tree bounds stop pruning: Prim's algorithm computing distances
+//    on the fly with a SIMD kernel, O(n) memory and O(n*n*d) time
+//
+//  input: per test case "n d" followed by n points of d coordinates, read by mst_common.h
+//  command line: [-t threads] [-prim | -kd] [input file]
+//  -prim and -kd force an algorithm, otherwise the k-d tree is used up to KD_MAX_DIM dimensions
+//  output: total length of the tree
+//
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include <vector>
+#include <algorithm>
+#include "mst_common.h"
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#define KD_MAX_DIM 8
+#define KD_LEAF_SIZE 16
+
+typedef struct _kd_node
+{
+    int begin;      // range of points in tree order
+    int end;
+    int left;       // children, -1 for a leaf
+    int right;
+    int comp;       // component shared by every point of the node, -1 if mixed
+    float bound;    // no point of the node has a candidate farther than this, squared
+}KD_NODE;
+
+typedef struct _candidate
+{
+    float dis;
+    int a;
+    int b;
+}CANDIDATE;
+
+thread_local int n, dim;
+thread_local double ret;
+// coordinates, n rows of dim floats, in k-d tree order when the tree is used
+thread_local std::vector<float> pts;
+thread_local std::vector<KD_NODE> nodes;
+// bounding boxes, 2*dim floats per node: minimum then maximum
+thread_local std::vector<float> boxes;
+thread_local std::vector<int> parent;
+thread_local std::vector<int> comp;
+thread_local std::vector<CANDIDATE> best;
+// prim
+thread_local std::vector<int> rest;
+thread_local std::vector<float> dis;
+
+// squared distance between two points
+static inline float dist2(const float* a, const float* b, int d)
+{
+    int i = 0;
+    float s = 0.0f;
+#ifdef __SSE__
+    __m128 acc = _mm_setzero_ps();
+    for(; i+4<=d; i+=4)
+    {
+        __m128 t = _mm_sub_ps(_mm_loadu_ps(a+i), _mm_loadu_ps(b+i));
+        acc = _mm_add_ps(acc, _mm_mul_ps(t, t));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    s = (lanes[0]+lanes[1]) + (lanes[2]+lanes[3]);
+#endif
+    for(; i<d; i++)
+    {
+        float t = a[i]-b[i];
+        s += t*t;
+    }
+    return s;
+}
+
+// ---- prim with distances on the fly ----
+
+void prim()
+{
+    int i, j, k, last;
+    float min, d;
+    // unvisited points are kept packed at the front of rest, with their distance to the tree in dis
+    rest.resize(n);
+    dis.assign(n, FLT_MAX);
+    for(i=0; i<n; i++)
+        rest[i] = i;
+    int remaining = n-1;
+    last = 0;
+    rest[0] = rest[remaining];
+    for(i=1; i<n; i++)
+    {
+        const float* p = &pts[(size_t)last*dim];
+        min = FLT_MAX;
+        k = 0;
+        for(j=0; j<remaining; j++)
+        {
+            d = dist2(p, &pts[(size_t)rest[j]*dim], dim);
+            if(d < dis[j])
+                dis[j] = d;
+            if(dis[j] < min)
+            {
+                min = dis[j];
+                k = j;
+            }
+        }
+        ret += sqrt((double)min);
+        last = rest[k];
+        --remaining;
+        rest[k] = rest[remaining];
+        dis[k] = dis[remaining];
+    }
+}
+
+// ---- dual-tree boruvka ----
+
+int findSet(int x)
+{
+    while(parent[x] != x)
+    {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+// build the subtree over points [begin, end) of order, splitting the widest dimension at the median
+int build(std::vector<int>& order, int begin, int end)
+{
+    int id = (int)nodes.size();
+    KD_NODE node;
+    node.begin = begin;
+    node.end = end;
+    node.left = node.right = -1;
+    node.comp = -1;
+    node.bound = FLT_MAX;
+    nodes.push_back(node);
+    boxes.resize(nodes.size()*2*dim);
+
+    float* box = &boxes[(size_t)id*2*dim];
+    for(int k=0; k<dim; k++)
+    {
+        box[k] = FLT_MAX;
+        box[dim+k] = -FLT_MAX;
+    }
+    for(int i=begin; i<end; i++)
+    {
+        const float* p = &pts[(size_t)order[i]*dim];
+        for(int k=0; k<dim; k++)
+        {
+            box[k] = std::min(box[k], p[k]);
+            box[dim+k] = std::max(box[dim+k], p[k]);
+        }
+    }
+    if(end-begin <= KD_LEAF_SIZE)
+        return id;
+
+    int split = 0;
+    for(int k=1; k<dim; k++)
+        if(box[dim+k]-box[k] > box[dim+split]-box[split])
+            split = k;
+    int mid = (begin+end)/2;
+    const std::vector<float>& coords = pts;
+    std::nth_element(order.begin()+begin, order.begin()+mid, order.begin()+end, [&](int a, int b) {
+        return coords[(size_t)a*dim+split] < coords[(size_t)b*dim+split];
+    });
+    int left = build(order, begin, mid);
+    int right = build(order, mid, end);
+    nodes[id].left = left;
+    nodes[id].right = right;
+    return id;
+}
+
+// squared distance between the bounding boxes of two nodes
+float boxDist2(int q, int r)
+{
+    const float* a = &boxes[(size_t)q*2*dim];
+    const float* b = &boxes[(size_t)r*2*dim];
+    float s = 0.0f;
+    for(int k=0; k<dim; k++)
+    {
+        float t = std::max(a[k]-b[dim+k], b[k]-a[dim+k]);
+        if(t > 0)
+            s += t*t;
+    }
+    return s;
+}
+
+// squared distance between a point and the bounding box of a node
+float pointBoxDist2(const float* p, int r)
+{
+    const float* b = &boxes[(size_t)r*2*dim];
+    float s = 0.0f;
+    for(int k=0; k<dim; k++)
+    {
+        float t = std::max(b[k]-p[k], p[k]-b[dim+k]);
+        if(t > 0)
+            s += t*t;
+    }
+    return s;
+}
+
+// squared distance between the centers of the bounding boxes of two nodes, times four
+float centerDist2(int q, int r)
+{
+    const float* a = &boxes[(size_t)q*2*dim];
+    const float* b = &boxes[(size_t)r*2*dim];
+    float s = 0.0f;
+    for(int k=0; k<dim; k++)
+    {
+        float t = (a[k]+a[dim+k]) - (b[k]+b[dim+k]);
+        s += t*t;
+    }
+    return s;
+}
+
+// label nodes whose points all belong to one component, and reset their bounds
+int labelComponents(int x)
+{
+    KD_NODE& node = nodes[x];
+    node.bound = FLT_MAX;
+    if(node.left == -1)
+    {
+        node.comp = comp[node.begin];
+        for(int i=node.begin+1; i<node.end; i++)
+            if(comp[i] != node.comp)
+            {
+                node.comp = -1;
+                break;
+            }
+    }
+    else
+    {
+        int l = labelComponents(node.left);
+        int r = labelComponents(node.right);
+        nodes[x].comp = l==r ? l : -1;
+    }
+    return nodes[x].comp;
+}
+
+void dualTree(int q, int r)
+{
+    KD_NODE& Q = nodes[q];
+    KD_NODE& R = nodes[r];
+    if(Q.comp!=-1 && Q.comp==R.comp)
+        return;
+    if(boxDist2(q, r) >= Q.bound)
+        return;
+
+    if(Q.left==-1 && R.left==-1)
+    {
+        // compare every pair of points, then tighten the bound of the query node
+        float bound = 0.0f;
+        for(int i=Q.begin; i<Q.end; i++)
+        {
+            CANDIDATE& c = best[comp[i]];
+            const float* p = &pts[(size_t)i*dim];
+            if(pointBoxDist2(p, r) >= c.dis)
+                continue;
+            for(int j=R.begin; j<R.end; j++)
+            {
+                if(comp[j] == comp[i])
+                    continue;
+                float d = dist2(p, &pts[(size_t)j*dim], dim);
+                if(d < c.dis)
+                {
+                    c.dis = d;
+                    c.a = i;
+                    c.b = j;
+                }
+            }
+        }
+        for(int i=Q.begin; i<Q.end; i++)
+            bound = std::max(bound, best[comp[i]].dis);
+        Q.bound = bound;
+        return;
+    }
+
+    if(Q.left!=-1 && (R.left==-1 || Q.end-Q.begin >= R.end-R.begin))
+    {
+        dualTree(Q.left, r);
+        dualTree(Q.right, r);
+        nodes[q].bound = std::max(nodes[Q.left].bound, nodes[Q.right].bound);
+    }
+    else
+    {
+        // visit the nearer reference child first so the bound tightens sooner
+        // boxes often touch, so ties are broken by the distance between box centers
+        int a = R.left;
+        int b = R.right;
+        float da = boxDist2(q, a);
+        float db = boxDist2(q, b);
+        if(db<da || (db==da && centerDist2(q, b)<centerDist2(q, a)))
+            std::swap(a, b);
+        dualTree(q, a);
+        dualTree(q, b);
+    }
+}
+
+void boruvka()
+{
+    int i, components;
+    std::vector<int> order(n);
+    for(i=0; i<n; i++)
+        order[i] = i;
+    nodes.clear();
+    boxes.clear();
+    build(order, 0, n);
+
+    // store the points in tree order so that leaves are contiguous
+    std::vector<float> sorted((size_t)n*dim);
+    for(i=0; i<n; i++)
+        memcpy(&sorted[(size_t)i*dim], &pts[(size_t)order[i]*dim], dim*sizeof(float));
+    pts.swap(sorted);
+
+    parent.resize(n);
+    comp.resize(n);
+    best.resize(n);
+    for(i=0; i<n; i++)
+        parent[i] = i;
+
+    for(components=n; components>1; )
+    {
+        for(i=0; i<n; i++)
+        {
+            comp[i] = findSet(i);
+            best[i].dis = FLT_MAX;
+            best[i].a = best[i].b = -1;
+        }
+        labelComponents(0);
+        dualTree(0, 0);
+
+        // add the nearest outgoing edge of every component, skipping the ones that became redundant
+        int merged = 0;
+        for(i=0; i<n; i++)
+        {
+            if(comp[i]!=i || best[i].a==-1)
+                continue;
+            int a = findSet(best[i].a);
+            int b = findSet(best[i].b);
+            if(a == b)
+                continue;
+            parent[a] = b;
+            ret += sqrt((double)best[i].dis);
+            components--;
+            merged++;
+        }
+        if(merged == 0)
+            break;
+    }
+}
+
+// solve one test case with the scratch arrays of the calling thread
+double solve(int points, int dimension, const double* coords, int engine)
+{
+    n = points;
+    dim = dimension;
+    ret = 0.0;
+    if(n <= 1 || dim <= 0)
+        return ret;
+    pts.resize((size_t)n*dim);
+    for(size_t i=0; i<(size_t)n*dim; i++)
+        pts[i] = (float)coords[i];
+
+    if(engine=='p' || (engine!='k' && dim>KD_MAX_DIM))
+        prim();
+    else
+        boruvka();
+    return ret;
+}
+
+int main(int argc, const char * argv[])
+{
+    GRAPH_OPTIONS opts;
+    std::vector<double> values;
+    int engine = 0;
+    parseGraphOptions(argc, argv, opts);
+    for(int i=1; i<argc; i++)
+    {
+        if(strcmp(argv[i], "-prim") == 0)
+            engine = 'p';
+        else if(strcmp(argv[i], "-kd") == 0)
+            engine = 'k';
+    }
+    if(!readRealInput(opts, values))
+        return 1;
+
+    // index the test cases
+    std::vector<size_t> starts;
+    std::vector<int> sizes, dims;
+    size_t pos = 0;
+    while(pos+2 <= values.size())
+    {
+        int points = (int)values[pos];
+        int dimension = (int)values[pos+1];
+        if(points<0 || dimension<0 || values.size()-pos-2 < (size_t)points*dimension)
+            break;
+        sizes.push_back(points);
+        dims.push_back(dimension);
+        starts.push_back(pos+2);
+        pos += 2+(size_t)points*dimension;
+    }
+
+    std::vector<double> results(starts.size());
+    workerPool((int)starts.size(), opts.threads, [&](int i) {
+        results[i] = solve(sizes[i], dims[i], &values[starts[i]], engine);
+    });
+    for(size_t i=0; i<results.size(); i++)
+        printf("%.6f\n", results[i]);
+    return 0;
+}
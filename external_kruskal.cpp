@@ -0,0 +1,355 @@
+//
+//  external_kruskal.cpp
+//  Algorithm
+//
+//  Implemented Kruskal's algorithm for edge lists larger than memory (external memory / out of core).
+//
+//  - run formation: the edge file is read in blocks that fit the memory budget, every block is sorted
+//    by weight and appended as a run to one temporary file; the next block is read by a second thread
+//    while the current one is sorted, so reading and sorting overlap
+//  - merge: the runs are merged with a k-way heap and the merged edges stream through a union-find
+//    of the vertices, the only structure whose size depends on the graph (5 bytes per vertex)
+//  - a run needs a read buffer of at least MERGE_BUFFER_EDGES edges during the merge, when the budget
+//    can't hold one per run, groups of runs are first merged into longer runs in extra passes
+//  - all file access is sequential, the kernel is asked to read ahead the next block of every run
+//  - the merge stops as soon as n-1 edges are accepted
+//  a graph whose edges fit in one block is sorted in memory without temporary files
+//
+//  input: binary edge list file of mst_common.h, "n m" followed by m triples "a b w" as 32-bit ints
+//  command line: [-mem MB] [-tmp dir] [-o tree file] graph file
+//  -mem is the peak memory budget (1024MB by default), -o writes the tree edges as binary triples
+//  output: weight of the minimum spanning forest
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// smallest read buffer of a run in the merge, in edges, it bounds how many runs are merged at once
+#define MERGE_BUFFER_EDGES 4096
+
+typedef struct edge
+{
+    int a;
+    int b;
+    int dis;
+}EDGE;
+
+// sequential reader over a range of a file
+typedef struct _run_reader
+{
+    int fd;
+    off_t offset;
+    off_t end;
+    std::vector<EDGE> buf;
+    size_t pos;
+    size_t count;
+}RUN_READER;
+
+int n;
+long long ret;
+long long accepted;
+std::vector<int> parent;
+std::vector<unsigned char> rankOf;
+FILE* treeFile;
+
+bool compare(const EDGE& lhs, const EDGE& rhs)
+{
+    return lhs.dis < rhs.dis;
+}
+
+// read exactly size bytes at offset unless the file ends, return the number of bytes read
+size_t readAt(int fd, void* data, size_t size, off_t offset)
+{
+    size_t done = 0;
+    while(done < size)
+    {
+        ssize_t got = pread(fd, (char*)data+done, size-done, offset+done);
+        if(got <= 0)
+            break;
+        done += got;
+    }
+    return done;
+}
+
+bool writeAll(int fd, const void* data, size_t size)
+{
+    size_t done = 0;
+    while(done < size)
+    {
+        ssize_t put = write(fd, (const char*)data+done, size-done);
+        if(put <= 0)
+            return false;
+        done += put;
+    }
+    return true;
+}
+
+// refill the buffer of a run and hint the kernel to fetch the block after it in the background
+bool refill(RUN_READER& r)
+{
+    r.pos = 0;
+    r.count = 0;
+    if(r.offset >= r.end)
+        return false;
+    size_t bytes = std::min((off_t)(r.buf.size()*sizeof(EDGE)), r.end-r.offset);
+    size_t got = readAt(r.fd, r.buf.data(), bytes, r.offset);
+    r.count = got/sizeof(EDGE);
+    r.offset += r.count*sizeof(EDGE);
+    if(r.offset < r.end)
+        posix_fadvise(r.fd, r.offset, std::min((off_t)bytes, r.end-r.offset), POSIX_FADV_WILLNEED);
+    return r.count > 0;
+}
+
+// temporary file that disappears with its descriptor, return -1 if it can't be created
+int tempFile(const std::string& dir)
+{
+    std::string path = dir+"/external_kruskal_XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+    int fd = mkstemp(name.data());
+    if(fd >= 0)
+        unlink(name.data());
+    return fd;
+}
+
+// merge the runs [first, first+count) of a run file by weight with a k-way heap,
+// every edge goes to sink until it returns false
+template <typename SINK>
+void mergeRuns(int fd, const std::vector<std::pair<off_t, off_t> >& ranges, size_t first, size_t count, size_t bufEdges, SINK sink)
+{
+    std::vector<RUN_READER> runs(count);
+    typedef std::pair<int, int> HEAP_ITEM;     // weight, run
+    std::priority_queue<HEAP_ITEM, std::vector<HEAP_ITEM>, std::greater<HEAP_ITEM> > heap;
+    for(size_t i=0; i<count; ++i)
+    {
+        runs[i].fd = fd;
+        runs[i].offset = ranges[first+i].first;
+        runs[i].end = ranges[first+i].second;
+        runs[i].buf.resize(bufEdges);
+        if(refill(runs[i]))
+            heap.push(HEAP_ITEM(runs[i].buf[0].dis, (int)i));
+    }
+    while(!heap.empty())
+    {
+        int i = heap.top().second;
+        heap.pop();
+        RUN_READER& r = runs[i];
+        if(!sink(r.buf[r.pos]))
+            break;
+        if(++r.pos<r.count || refill(r))
+            heap.push(HEAP_ITEM(r.buf[r.pos].dis, i));
+    }
+}
+
+// ---- union-find ----
+
+int findSet(int x)
+{
+    while(parent[x] != x)
+    {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+// edges with a vertex outside the graph are dropped before they are sorted
+bool outOfRange(const EDGE& e)
+{
+    return e.a<0 || e.a>=n || e.b<0 || e.b>=n;
+}
+
+// offer the next edge in weight order, return false once the tree is complete
+bool offer(const EDGE& e)
+{
+    int a = findSet(e.a);
+    int b = findSet(e.b);
+    if(a != b)
+    {
+        if(rankOf[a] < rankOf[b])
+            std::swap(a, b);
+        parent[b] = a;
+        if(rankOf[a] == rankOf[b])
+            rankOf[a]++;
+        ret += e.dis;
+        accepted++;
+        if(treeFile)
+            fwrite(&e, sizeof(EDGE), 1, treeFile);
+    }
+    return accepted < n-1;
+}
+
+int main(int argc, const char * argv[])
+{
+    long long budgetMB = 1024;
+    std::string tmpDir = "/tmp";
+    const char* treePath = NULL;
+    const char* path = NULL;
+    for(int i=1; i<argc; ++i)
+    {
+        if(strcmp(argv[i], "-mem")==0 && i+1<argc)
+            budgetMB = atoll(argv[++i]);
+        else if(strcmp(argv[i], "-tmp")==0 && i+1<argc)
+            tmpDir = argv[++i];
+        else if(strcmp(argv[i], "-o")==0 && i+1<argc)
+            treePath = argv[++i];
+        else
+            path = argv[i];
+    }
+    if(path == NULL)
+    {
+        fprintf(stderr, "usage: external_kruskal [-mem MB] [-tmp dir] [-o tree file] graph file\n");
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    int header[2];
+    if(fd<0 || fstat(fd, &st)!=0 || readAt(fd, header, sizeof(header), 0)!=sizeof(header))
+    {
+        fprintf(stderr, "error: can't read %s\n", path);
+        return 1;
+    }
+    if(header[0]<0 || header[1]<0)
+    {
+        fprintf(stderr, "error: invalid header in %s\n", path);
+        return 1;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    n = header[0];
+    long long m = std::min((long long)header[1], (long long)((st.st_size-sizeof(header))/sizeof(EDGE)));
+
+    // the union-find is kept for the whole run, edge buffers share what is left of the budget
+    long long budget = budgetMB<<20;
+    long long ufBytes = (long long)n*(sizeof(int)+1);
+    long long blockEdges = (budget-ufBytes)/(2*(long long)sizeof(EDGE));
+    if(blockEdges < 1024)
+    {
+        fprintf(stderr, "error: memory budget too small for %d vertices\n", n);
+        return 1;
+    }
+    blockEdges = std::min(blockEdges, std::max(m, 1LL));
+
+    parent.resize(n);
+    rankOf.assign(n, 0);
+    for(int i=0; i<n; ++i)
+        parent[i] = i;
+    ret = 0;
+    accepted = 0;
+    treeFile = treePath ? fopen(treePath, "wb") : NULL;
+
+    // ---- run formation, reading the next block while sorting the current one ----
+    std::vector<EDGE> current(blockEdges), next(blockEdges);
+    int runFd = -1;
+    off_t runEnd = 0;
+    std::vector<std::pair<off_t, off_t> > runRanges;
+    off_t inputOffset = sizeof(header);
+    off_t inputEnd = sizeof(header) + m*(off_t)sizeof(EDGE);
+    size_t currentCount = readAt(fd, current.data(), std::min((off_t)(blockEdges*sizeof(EDGE)), inputEnd-inputOffset), inputOffset)/sizeof(EDGE);
+    inputOffset += currentCount*sizeof(EDGE);
+    bool single = inputOffset >= inputEnd;
+
+    while(currentCount > 0)
+    {
+        size_t nextCount = 0;
+        std::thread reader([&]() {
+            size_t bytes = std::min((off_t)(blockEdges*sizeof(EDGE)), inputEnd-inputOffset);
+            nextCount = readAt(fd, next.data(), bytes, inputOffset)/sizeof(EDGE);
+        });
+        size_t validCount = std::remove_if(current.begin(), current.begin()+currentCount, outOfRange) - current.begin();
+        std::sort(current.begin(), current.begin()+validCount, compare);
+        if(single)
+        {
+            for(size_t i=0; i<validCount && offer(current[i]); ++i)
+                ;
+        }
+        else if(validCount > 0)
+        {
+            // all runs go to one file, so the merge keeps a single descriptor open however many there are
+            if(runFd < 0)
+                runFd = tempFile(tmpDir);
+            if(runFd < 0 || !writeAll(runFd, current.data(), validCount*sizeof(EDGE)))
+            {
+                fprintf(stderr, "error: can't write run file in %s\n", tmpDir.c_str());
+                reader.join();
+                return 1;
+            }
+            runRanges.push_back(std::make_pair(runEnd, runEnd+(off_t)(validCount*sizeof(EDGE))));
+            runEnd += validCount*sizeof(EDGE);
+        }
+        reader.join();
+        inputOffset += nextCount*sizeof(EDGE);
+        current.swap(next);
+        currentCount = nextCount;
+    }
+    close(fd);
+    std::vector<EDGE>().swap(current);
+    std::vector<EDGE>().swap(next);
+
+    // ---- merge passes, the buffers of the runs merged at once and the output fit the budget ----
+    long long bufferBytes = budget-ufBytes;
+    size_t fanIn = (size_t)std::max(2LL, bufferBytes/(MERGE_BUFFER_EDGES*(long long)sizeof(EDGE)) - 1);
+    while(runRanges.size() > fanIn)
+    {
+        int mergedFd = tempFile(tmpDir);
+        off_t mergedEnd = 0;
+        bool written = mergedFd >= 0;
+        std::vector<std::pair<off_t, off_t> > mergedRanges;
+        for(size_t first=0; first<runRanges.size() && written; first+=fanIn)
+        {
+            size_t count = std::min(fanIn, runRanges.size()-first);
+            size_t bufEdges = bufferBytes/((count+1)*(long long)sizeof(EDGE));
+            std::vector<EDGE> out;
+            out.reserve(bufEdges);
+            off_t start = mergedEnd;
+            mergeRuns(runFd, runRanges, first, count, bufEdges, [&](const EDGE& e) {
+                out.push_back(e);
+                if(out.size() == bufEdges)
+                {
+                    written = written && writeAll(mergedFd, out.data(), out.size()*sizeof(EDGE));
+                    mergedEnd += out.size()*sizeof(EDGE);
+                    out.clear();
+                }
+                return written;
+            });
+            written = written && writeAll(mergedFd, out.data(), out.size()*sizeof(EDGE));
+            mergedEnd += out.size()*sizeof(EDGE);
+            mergedRanges.push_back(std::make_pair(start, mergedEnd));
+        }
+        if(!written)
+        {
+            fprintf(stderr, "error: can't write run file in %s\n", tmpDir.c_str());
+            return 1;
+        }
+        close(runFd);
+        runFd = mergedFd;
+        runRanges.swap(mergedRanges);
+    }
+
+    // ---- last k-way merge of the runs into the union-find ----
+    if(!runRanges.empty())
+    {
+        size_t k = runRanges.size();
+        size_t bufEdges = bufferBytes/(k*(long long)sizeof(EDGE));
+        posix_fadvise(runFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        mergeRuns(runFd, runRanges, 0, k, bufEdges, offer);
+    }
+    if(runFd >= 0)
+        close(runFd);
+
+    if(treeFile)
+        fclose(treeFile);
+    printf("%lld\n", ret);
+    return 0;
+}
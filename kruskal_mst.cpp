@@ -6,17 +6,31 @@
 //  Copyright (c) 2015 Ray Shen. All rights reserved.
 //
 //  Implemented Kruskal's algorithm for finding minimum spanning tree in a weighted undirected graph.
+//
+//  Input is read in bulk by mst_common.h, either as adjacency matrices or as edge lists.
+//  Test cases are solved in parallel, so the working arrays are per thread.
+//  All of them come from the arena of the thread, so one test case costs no malloc or free
+//  once the arena has grown to fit it.
+//  Components are kept in a union-find with union by size and path halving, the same one the
+//  clustering uses, so the edge pass is O(m alpha(n)) after sorting.
+//  A disconnected graph gets a minimum spanning forest, with one union-find set per tree.
+//
+//  Single linkage clustering with -k clusters or -d distance threshold:
+//  the accepted edges in Kruskal's order are exactly the merges of single linkage clustering,
+//  so the dendrogram and the flat clusters come from one union-find pass in O(n) memory,
+//  instead of the O(n*n) distance matrix of naive hierarchical clustering.
+//  Output per test case, after the tree weight:
+//  - the number of merges, then one line "c1 c2 height size" per merge,
+//    where clusters 0..n-1 are the vertices and merge i creates cluster n+i
+//  - the cluster label of every vertex, numbered in order of first appearance
 // 
 
 #include <cstdio>
 #include <cstring>
 #include <algorithm>
-
-typedef struct _node
-{
-    int id;
-    _node* next;
-}NODE, *PNODE;
+#include <vector>
+#include <string>
+#include "mst_common.h"
 
 typedef struct edge
 {
@@ -25,123 +39,214 @@ typedef struct edge
     int dis;
 }EDGE;
 
-int map[100][100];
-int n;
-int ret;
-int edgenum;
-EDGE elist[100*99/2];
-PNODE plist[100][2];
+thread_local ARENA arena;
+thread_local int n;
+thread_local long long ret;
+thread_local int edgenum;
+thread_local EDGE* elist;
+// tree edges in the order they were accepted
+thread_local EDGE* accepted;
+thread_local int acceptednum;
+// component of every vertex
+thread_local int* label;
+thread_local int comps;
+// union-find of the components, used again for clustering
+thread_local int* ufParent;
+thread_local int* ufSize;
+thread_local int* ufCluster;
 
 bool compare(const EDGE& lhs, const edge& rhs)
 {
     return lhs.dis < rhs.dis;
 }
 
-void Kruskal()
+// fill elist with the edges of a test case
+// the matrix layout contributes its upper triangle, self loops of an edge list are dropped
+void buildEdges(const GRAPH_INSTANCE& g, GraphLayout layout)
 {
-    int i, a, b;
-    for(i=0; i<edgenum; i++)
+    int i, j, k;
+    k = 0;
+    if(layout == LAYOUT_MATRIX)
     {
-        a = elist[i].a;
-        b = elist[i].b;
-        if(plist[a][0]==NULL && plist[b][0]==NULL)
+        elist = arenaArray<EDGE>(arena, (size_t)g.n*(g.n-1)/2);
+        for(i=0; i<g.n; i++)
         {
-            PNODE phead = new NODE;
-            PNODE pnode = new NODE;
-            phead->id = a;
-            phead->next = pnode;
-            pnode->id = b;
-            pnode->next = NULL;
-            plist[a][0] = phead;
-            plist[b][0] = phead;
-            plist[a][1] = pnode;
-            plist[b][1] = pnode;
-            ret += elist[i].dis;
-        }
-        else if(plist[a][0]==NULL && plist[b][0]!=NULL)
-        {
-            PNODE ptail = plist[b][1];
-            PNODE phead = new NODE;
-            phead->id = a;
-            phead->next = plist[b][0];
-            PNODE ptemp = phead;
-            while(ptemp != NULL)
+            const int* row = g.data + (size_t)i*g.n;
+            for(j=i+1; j<g.n; j++)
             {
-                plist[ptemp->id][0] = phead;
-                plist[ptemp->id][1] = ptail;
-                ptemp = ptemp->next;
+                elist[k].a = i;
+                elist[k].b = j;
+                elist[k].dis = row[j];
+                k++;
             }
-            ret += elist[i].dis;
         }
-        else if(plist[a][0]!=NULL && plist[b][0]==NULL)
-        {
-            PNODE ptail = plist[a][1];
-            PNODE phead = new NODE;
-            phead->id = b;
-            phead->next = plist[a][0];
-            PNODE ptemp = phead;
-            while(ptemp != NULL)
-            {
-                plist[ptemp->id][0] = phead;
-                plist[ptemp->id][1] = ptail;
-                ptemp = ptemp->next;
-            }
-            ret += elist[i].dis;
-        }
-        else if(plist[a][0]!=NULL && plist[b][0]!=NULL && plist[a][0]!=plist[b][0])
+    }
+    else
+    {
+        elist = arenaArray<EDGE>(arena, g.m);
+        for(i=0; i<g.m; i++)
         {
-            PNODE phead = plist[a][0];
-            PNODE ptail = plist[b][1];
-            plist[a][1]->next = plist[b][0];
-            PNODE ptemp = phead;
-            while(ptemp != NULL)
-            {
-                plist[ptemp->id][0] = phead;
-                plist[ptemp->id][1] = ptail;
-                ptemp = ptemp->next;
-            }
-            ret += elist[i].dis;
+            EDGE e;
+            e.a = g.data[3*i];
+            e.b = g.data[3*i+1];
+            e.dis = g.data[3*i+2];
+            if(e.a<0 || e.a>=g.n || e.b<0 || e.b>=g.n || e.a==e.b)
+                continue;
+            elist[k++] = e;
         }
-        else continue;
     }
-    PNODE pn = plist[0][0];
-    PNODE pold = NULL;
-    while(pn != NULL)
+    edgenum = k;
+}
+
+void initSets()
+{
+    for(int i=0; i<n; i++)
     {
-        pold = pn;
-        pn = pn->next;
-        delete pold;
+        ufParent[i] = i;
+        ufSize[i] = 1;
+        ufCluster[i] = i;
     }
 }
 
+int findSet(int x)
+{
+    while(ufParent[x] != x)
+    {
+        ufParent[x] = ufParent[ufParent[x]];
+        x = ufParent[x];
+    }
+    return x;
+}
+
+// merge the sets of a and b, the merged set is named cluster
+void unionSets(int a, int b, int cluster)
+{
+    if(ufSize[a] < ufSize[b])
+        std::swap(a, b);
+    ufParent[b] = a;
+    ufSize[a] += ufSize[b];
+    ufCluster[a] = cluster;
+}
+
+void Kruskal()
+{
+    int i, a, b;
+    accepted = arenaArray<EDGE>(arena, n);
+    acceptednum = 0;
+    initSets();
+    for(i=0; i<edgenum && acceptednum<n-1; i++)
+    {
+        a = findSet(elist[i].a);
+        b = findSet(elist[i].b);
+        if(a == b)
+            continue;
+        unionSets(a, b, 0);
+        ret += elist[i].dis;
+        // only accepted edges get here, in increasing weight order
+        accepted[acceptednum++] = elist[i];
+    }
+
+    // label the components in order of first appearance
+    label = arenaArray<int>(arena, n);
+    for(i=0; i<n; i++)
+        label[i] = -1;
+    comps = 0;
+    for(i=0; i<n; i++)
+    {
+        a = findSet(i);
+        if(label[a] == -1)
+            label[a] = comps++;
+        label[i] = label[a];
+    }
+}
+
+// write the dendrogram and the flat cluster labels of the current test case to out
+void cluster(const GRAPH_OPTIONS& opts, std::string& out)
+{
+    int i, a, b, cuts;
+    char line[64];
+
+    // dendrogram, heights are non-decreasing since edges were accepted in sorted order
+    initSets();
+    snprintf(line, sizeof(line), "%d\n", acceptednum);
+    out += line;
+    for(i=0; i<acceptednum; i++)
+    {
+        a = findSet(accepted[i].a);
+        b = findSet(accepted[i].b);
+        snprintf(line, sizeof(line), "%d %d %d %d\n", ufCluster[a], ufCluster[b], accepted[i].dis, ufSize[a]+ufSize[b]);
+        out += line;
+        unionSets(a, b, n+i);
+    }
+
+    // cut the tree, a disconnected graph can't have fewer clusters than components
+    cuts = 0;
+    if(opts.clusters > 0)
+        cuts = std::max(0, std::min(n-opts.clusters, acceptednum));
+    else
+    {
+        while(cuts<acceptednum && accepted[cuts].dis<=opts.threshold)
+            cuts++;
+    }
+    initSets();
+    for(i=0; i<cuts; i++)
+        unionSets(findSet(accepted[i].a), findSet(accepted[i].b), 0);
+
+    // label clusters in order of first appearance
+    int* flat = ufCluster;
+    for(i=0; i<n; i++)
+        flat[i] = -1;
+    int labels = 0;
+    for(i=0; i<n; i++)
+    {
+        a = findSet(i);
+        if(flat[a] == -1)
+            flat[a] = labels++;
+        snprintf(line, sizeof(line), i ? " %d" : "%d", flat[a]);
+        out += line;
+    }
+    out += "\n";
+}
+
+// solve one test case with the scratch arena of the calling thread
+long long solve(const GRAPH_INSTANCE& g, GraphLayout layout, const GRAPH_OPTIONS& opts, std::string& out)
+{
+    arenaReset(arena);
+    n = g.n;
+    ret = 0;
+    ufParent = arenaArray<int>(arena, n);
+    ufSize = arenaArray<int>(arena, n);
+    ufCluster = arenaArray<int>(arena, n);
+    buildEdges(g, layout);
+    std::sort(elist, elist+edgenum, compare);
+    Kruskal();
+    if(opts.forest)
+        writeForest(n, comps, label, accepted, acceptednum, out);
+    if(opts.clusters>0 || opts.clusterByDistance)
+        cluster(opts, out);
+    return ret;
+}
+
 int main(int argc, const char * argv[])
 {
-    int i, j, k;
-    while(scanf("%d", &n) != EOF)
+    GRAPH_OPTIONS opts;
+    GRAPH_INPUT in;
+    std::vector<GRAPH_INSTANCE> instances;
+    parseGraphOptions(argc, argv, opts);
+    if(!openGraphInput(opts, in))
+        return 1;
+    collectGraphInstances(in, instances);
+
+    std::vector<long long> results(instances.size());
+    std::vector<std::string> clusters(instances.size());
+    workerPool((int)instances.size(), opts.threads, [&](int i) {
+        results[i] = solve(instances[i], in.layout, opts, clusters[i]);
+    });
+    for(size_t i=0; i<results.size(); i++)
     {
-        k=0;
-        edgenum = n*(n-1)/2;
-        ret = 0;
-        memset(plist, 0, sizeof(plist));
-        memset(elist, 0, sizeof(elist));
-        for(i=0; i<n; i++)
-        {
-            for(j=0; j<n; j++)
-            {
-                scanf("%d", &map[i][j]);
-                if(j>i)
-                {
-                    elist[k].a = i;
-                    elist[k].b = j;
-                    elist[k].dis = map[i][j];
-                    k++;
-                }
-            }
-        }
-        std::sort(elist, elist+edgenum, compare);
-        Kruskal();
-        printf("%d\n", ret);
+        printf("%lld\n", results[i]);
+        fputs(clusters[i].c_str(), stdout);
     }
+    closeGraphInput(in);
     return 0;
  }
- 
\ No newline at end of file
@@ -0,0 +1,521 @@
+//
+//  mst_benchmark.cpp
+//  Algorithm
+//
+//  Benchmark of the minimum spanning tree programs over generated graphs of different shapes and sizes,
+//  to choose an algorithm by input shape and to catch performance regressions.
+//
+//  graphs are generated from a seed, written as binary edge lists (see mst_common.h) so that parsing
+//  doesn't dominate, and every program runs as a child process on them
+//  - complete:  every pair of vertices
+//  - random:    Erdos-Renyi graph with the given average degree
+//  - grid:      square lattice with 4 neighbors
+//  - geometric: points in the unit square connected within the radius giving the average degree,
+//               weighted by distance; euclidean_mst.cpp gets the points themselves
+//  - powerlaw:  Barabasi-Albert preferential attachment, degree/2 edges per new vertex
+//  sizes go from 10^2 vertices up to the maximum in powers of 10,
+//  runs that would go over the memory or edge budget are skipped
+//
+//  reported per run: wall time, edges per second, peak resident memory of the child,
+//  and cache misses and references when perf is available
+//  a child starts with the peak of the benchmark itself, which fork, vfork and posix_spawn all pass on
+//  through exec, so a peak at or below the benchmark's own is shown as "<" that bound
+//  a child runs in its own process group, the timeout kills the whole group, perf and the program under it
+//  a '*' after the weight marks a result that differs from the other programs on the same graph
+//
+//  command line: [-bin dir] [-max n] [-degree d] [-seed s] [-mem MB] [-edges m] [-timeout seconds] [-noperf]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+typedef struct _engine
+{
+    const char* name;
+    const char* program;
+    const char* flags;  // space separated, before the input file
+    bool dense;     // builds an n*n matrix from the edge list
+    bool points;    // reads coordinates instead of edges
+}ENGINE;
+
+ENGINE engines[] =
+{
+    {"prim", "prim_mst", "-e -b", true, false},
+    {"kruskal", "kruskal_mst", "-e -b", false, false},
+    {"dynamic", "dynamic_mst", "-e -b", false, false},
+    {"external", "external_kruskal", "", false, false},
+    {"euclidean", "euclidean_mst", "", false, true},
+};
+
+const char* graphKinds[] = {"complete", "random", "grid", "geometric", "powerlaw"};
+
+typedef struct _run_result
+{
+    bool ok;
+    bool timeout;
+    double seconds;
+    long peakKB;
+    long baselineKB;    // peak of the benchmark when the child started, peakKB is only known above it
+    long long cacheMisses;
+    long long cacheReferences;
+    std::string output;
+}RUN_RESULT;
+
+std::string binDir = ".";
+long long maxVertices = 10000000;
+int degree = 8;
+unsigned long long seed = 1;
+long long memBudgetMB = 4096;
+long long edgeBudget = 50000000;
+int timeoutSeconds = 120;
+bool usePerf = true;
+
+std::vector<int> edges;         // n, m, then triples a b w
+std::vector<float> points;      // x y per vertex, geometric graphs only
+
+// ---- graph generators ----
+
+void addEdge(int a, int b, int w)
+{
+    edges.push_back(a);
+    edges.push_back(b);
+    edges.push_back(w);
+}
+
+// every generator fills edges with the triples, the header is added by generate()
+void generateComplete(int n, std::mt19937_64& rng)
+{
+    std::uniform_int_distribution<int> weight(1, 1000000);
+    for(int i=0; i<n; ++i)
+        for(int j=i+1; j<n; ++j)
+            addEdge(i, j, weight(rng));
+}
+
+void generateRandom(int n, std::mt19937_64& rng)
+{
+    std::uniform_int_distribution<int> weight(1, 1000000);
+    std::uniform_int_distribution<int> vertex(0, n-1);
+    long long m = (long long)n*degree/2;
+    for(long long e=0; e<m; ++e)
+    {
+        int a = vertex(rng);
+        int b = vertex(rng);
+        if(a != b)
+            addEdge(a, b, weight(rng));
+    }
+}
+
+void generateGrid(int n, std::mt19937_64& rng)
+{
+    std::uniform_int_distribution<int> weight(1, 1000000);
+    int side = (int)sqrt((double)n);
+    for(int i=0; i<n; ++i)
+    {
+        int c = i%side;
+        if(c+1<side && i+1<n)
+            addEdge(i, i+1, weight(rng));
+        if(i+side < n)
+            addEdge(i, i+side, weight(rng));
+    }
+}
+
+// connect points closer than the radius, found through a grid of cells as large as the radius
+void generateGeometric(int n, std::mt19937_64& rng)
+{
+    std::uniform_real_distribution<float> coord(0.0f, 1.0f);
+    points.resize((size_t)n*2);
+    for(size_t i=0; i<points.size(); ++i)
+        points[i] = coord(rng);
+
+    double radius = sqrt(degree/(M_PI*n));
+    int cells = std::max(1, (int)(1.0/radius));
+    std::vector<std::vector<int> > grid((size_t)cells*cells);
+    for(int i=0; i<n; ++i)
+    {
+        int cx = std::min(cells-1, (int)(points[2*i]*cells));
+        int cy = std::min(cells-1, (int)(points[2*i+1]*cells));
+        grid[(size_t)cx*cells+cy].push_back(i);
+    }
+    for(int i=0; i<n; ++i)
+    {
+        int cx = std::min(cells-1, (int)(points[2*i]*cells));
+        int cy = std::min(cells-1, (int)(points[2*i+1]*cells));
+        for(int x=std::max(0, cx-1); x<=std::min(cells-1, cx+1); ++x)
+            for(int y=std::max(0, cy-1); y<=std::min(cells-1, cy+1); ++y)
+            {
+                const std::vector<int>& cell = grid[(size_t)x*cells+y];
+                for(size_t k=0; k<cell.size(); ++k)
+                {
+                    int j = cell[k];
+                    if(j <= i)
+                        continue;
+                    double dx = points[2*i]-points[2*j];
+                    double dy = points[2*i+1]-points[2*j+1];
+                    double d = sqrt(dx*dx+dy*dy);
+                    if(d <= radius)
+                        addEdge(i, j, (int)(d*1000000)+1);
+                }
+            }
+    }
+}
+
+// preferential attachment: picking a random endpoint of an existing edge picks a vertex by degree
+void generatePowerLaw(int n, std::mt19937_64& rng)
+{
+    std::uniform_int_distribution<int> weight(1, 1000000);
+    int k = std::max(1, degree/2);
+    std::vector<int> ends;
+    for(int i=1; i<n; ++i)
+    {
+        for(int e=0; e<k && e<i; ++e)
+        {
+            int j;
+            if(ends.empty())
+                j = 0;
+            else
+                j = ends[std::uniform_int_distribution<size_t>(0, ends.size()-1)(rng)];
+            if(j == i)
+                continue;
+            addEdge(i, j, weight(rng));
+            ends.push_back(i);
+            ends.push_back(j);
+        }
+    }
+}
+
+// expected number of edges, to check the budget before generating
+long long expectedEdges(const std::string& kind, long long n)
+{
+    if(kind == "complete")
+        return n*(n-1)/2;
+    if(kind == "grid")
+        return 2*n;
+    return n*degree/2;
+}
+
+void generate(const std::string& kind, int n)
+{
+    // every graph has its own stream, so adding sizes or kinds doesn't change the others
+    std::seed_seq seq{(unsigned long long)seed, (unsigned long long)n, (unsigned long long)std::hash<std::string>()(kind)};
+    std::mt19937_64 rng(seq);
+    edges.clear();
+    points.clear();
+    edges.push_back(n);
+    edges.push_back(0);
+    if(kind == "complete")
+        generateComplete(n, rng);
+    else if(kind == "random")
+        generateRandom(n, rng);
+    else if(kind == "grid")
+        generateGrid(n, rng);
+    else if(kind == "geometric")
+        generateGeometric(n, rng);
+    else
+        generatePowerLaw(n, rng);
+    edges[1] = (int)((edges.size()-2)/3);
+}
+
+bool writeFile(const std::string& path, const void* data, size_t size)
+{
+    FILE* fp = fopen(path.c_str(), "wb");
+    if(fp == NULL)
+        return false;
+    bool ok = fwrite(data, 1, size, fp) == size;
+    fclose(fp);
+    return ok;
+}
+
+bool writePoints(const std::string& path, int n)
+{
+    FILE* fp = fopen(path.c_str(), "w");
+    if(fp == NULL)
+        return false;
+    fprintf(fp, "%d 2\n", n);
+    for(int i=0; i<n; ++i)
+        fprintf(fp, "%.7f %.7f\n", points[2*i], points[2*i+1]);
+    fclose(fp);
+    return true;
+}
+
+// ---- running ----
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+std::string readText(const std::string& path)
+{
+    std::string text;
+    FILE* fp = fopen(path.c_str(), "r");
+    if(fp == NULL)
+        return text;
+    char buf[4096];
+    size_t got;
+    while((got = fread(buf, 1, sizeof(buf), fp)) > 0)
+        text.append(buf, got);
+    fclose(fp);
+    return text;
+}
+
+// counters from "perf stat -x ," output, one "value,unit,event,..." line per event
+long long perfCounter(const std::string& text, const char* event)
+{
+    size_t pos = text.find(std::string(",")+event);
+    if(pos == std::string::npos)
+        return -1;
+    size_t line = text.rfind('\n', pos);
+    line = line==std::string::npos ? 0 : line+1;
+    const char* p = text.c_str()+line;
+    if(*p<'0' || *p>'9')
+        return -1;
+    return atoll(p);
+}
+
+std::string counter(long long value)
+{
+    char buf[32];
+    if(value < 0)
+        return "-";
+    snprintf(buf, sizeof(buf), "%lld", value);
+    return buf;
+}
+
+// peak memory column, the child's peak if it went over the benchmark's own
+std::string peakMB(const RUN_RESULT& r)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), r.peakKB>r.baselineKB ? "%.1f" : "<%.1f", std::max(r.peakKB, r.baselineKB)/1024.0);
+    return buf;
+}
+
+// run the program on the input file as a child process in its own process group,
+// the group is killed after the timeout; SIGCHLD is blocked so that the wait can time out on it
+RUN_RESULT runEngine(const ENGINE& engine, const std::string& input, const std::string& scratch)
+{
+    RUN_RESULT result;
+    result.ok = false;
+    result.timeout = false;
+    result.seconds = 0.0;
+    result.peakKB = 0;
+    result.baselineKB = 0;
+    result.cacheMisses = -1;
+    result.cacheReferences = -1;
+
+    std::string program = binDir+"/"+engine.program;
+    std::string outPath = scratch+".out";
+    std::string perfPath = scratch+".perf";
+    std::vector<std::string> args;
+    if(usePerf)
+    {
+        args.push_back("perf");
+        args.push_back("stat");
+        args.push_back("-x");
+        args.push_back(",");
+        args.push_back("-e");
+        args.push_back("cache-misses,cache-references");
+        args.push_back("-o");
+        args.push_back(perfPath);
+        args.push_back("--");
+    }
+    args.push_back(program);
+    for(const char* p=engine.flags; *p; )
+    {
+        const char* q = strchr(p, ' ');
+        if(q == NULL)
+            q = p+strlen(p);
+        if(q > p)
+            args.push_back(std::string(p, q));
+        p = *q ? q+1 : q;
+    }
+    args.push_back(input);
+    std::vector<char*> argv;
+    for(size_t i=0; i<args.size(); ++i)
+        argv.push_back((char*)args[i].c_str());
+    argv.push_back(NULL);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.baselineKB = usage.ru_maxrss;
+    sigset_t childSignal;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+
+    double start = now();
+    pid_t pid = fork();
+    if(pid == 0)
+    {
+        setpgid(0, 0);
+        sigprocmask(SIG_UNBLOCK, &childSignal, NULL);
+        int fd = open(outPath.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if(fd >= 0)
+        {
+            dup2(fd, 1);
+            close(fd);
+        }
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    if(pid < 0)
+        return result;
+    // also set here, so the group exists whichever of parent and child runs first
+    setpgid(pid, pid);
+
+    int status;
+    int waited;
+    while((waited = wait4(pid, &status, WNOHANG, &usage)) == 0)
+    {
+        double left = start+timeoutSeconds-now();
+        if(left <= 0)
+        {
+            kill(-pid, SIGKILL);
+            result.timeout = true;
+            waited = wait4(pid, &status, 0, &usage);
+            break;
+        }
+        struct timespec wait = {(time_t)left, (long)((left-(time_t)left)*1e9)};
+        sigtimedwait(&childSignal, NULL, &wait);
+    }
+    if(waited < 0)
+        return result;
+    result.seconds = now()-start;
+    result.peakKB = usage.ru_maxrss;
+    if(!result.timeout && WIFEXITED(status) && WEXITSTATUS(status)==0)
+    {
+        result.ok = true;
+        result.output = readText(outPath);
+        size_t eol = result.output.find('\n');
+        if(eol != std::string::npos)
+            result.output.resize(eol);
+    }
+    if(usePerf)
+    {
+        std::string perf = readText(perfPath);
+        result.cacheMisses = perfCounter(perf, "cache-misses");
+        result.cacheReferences = perfCounter(perf, "cache-references");
+    }
+    unlink(outPath.c_str());
+    unlink(perfPath.c_str());
+    return result;
+}
+
+int main(int argc, const char * argv[])
+{
+    for(int i=1; i<argc; ++i)
+    {
+        if(strcmp(argv[i], "-bin")==0 && i+1<argc)
+            binDir = argv[++i];
+        else if(strcmp(argv[i], "-max")==0 && i+1<argc)
+            maxVertices = (long long)atof(argv[++i]);
+        else if(strcmp(argv[i], "-degree")==0 && i+1<argc)
+            degree = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-seed")==0 && i+1<argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-mem")==0 && i+1<argc)
+            memBudgetMB = atoll(argv[++i]);
+        else if(strcmp(argv[i], "-edges")==0 && i+1<argc)
+            edgeBudget = (long long)atof(argv[++i]);
+        else if(strcmp(argv[i], "-timeout")==0 && i+1<argc)
+            timeoutSeconds = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-noperf") == 0)
+            usePerf = false;
+    }
+    if(usePerf && system("perf stat -e cache-misses true > /dev/null 2>&1") != 0)
+        usePerf = false;
+    // a finished child is waited for with sigtimedwait, which needs SIGCHLD blocked
+    sigset_t childSignal;
+    sigemptyset(&childSignal);
+    sigaddset(&childSignal, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &childSignal, NULL);
+
+    char scratchTemplate[] = "/tmp/mst_benchmark_XXXXXX";
+    int fd = mkstemp(scratchTemplate);
+    if(fd < 0)
+    {
+        fprintf(stderr, "error: can't create scratch file\n");
+        return 1;
+    }
+    close(fd);
+    std::string scratch = scratchTemplate;
+    std::string graphPath = scratch+".bin";
+    std::string pointsPath = scratch+".txt";
+
+    printf("%-10s %9s %10s %-10s %10s %12s %9s %12s %12s %s\n", "graph", "n", "m", "engine",
+           "seconds", "edges/s", "peak MB", "cache-miss", "cache-ref", "weight");
+    for(size_t kind=0; kind<sizeof(graphKinds)/sizeof(graphKinds[0]); ++kind)
+    {
+        std::string name = graphKinds[kind];
+        for(long long n=100; n<=maxVertices; n*=10)
+        {
+            if(expectedEdges(name, n) > edgeBudget)
+            {
+                printf("%-10s %9lld %10s skipped, over the edge budget\n", name.c_str(), n, "-");
+                continue;
+            }
+            generate(name, (int)n);
+            long long m = edges[1];
+            if(!writeFile(graphPath, edges.data(), edges.size()*sizeof(int)))
+            {
+                fprintf(stderr, "error: can't write %s\n", graphPath.c_str());
+                break;
+            }
+            bool hasPoints = !points.empty();
+            if(hasPoints)
+                writePoints(pointsPath, (int)n);
+            // a forked child starts with the resident memory of this process,
+            // which would show up in its peak, so the graph is released first
+            std::vector<int>().swap(edges);
+            std::vector<float>().swap(points);
+
+            std::string reference;
+            for(size_t e=0; e<sizeof(engines)/sizeof(engines[0]); ++e)
+            {
+                const ENGINE& engine = engines[e];
+                if(engine.points && !hasPoints)
+                    continue;
+                if(engine.dense && n*n*sizeof(int) > (unsigned long long)memBudgetMB<<20)
+                {
+                    printf("%-10s %9lld %10lld %-10s skipped, over the memory budget\n", name.c_str(), n, m, engine.name);
+                    continue;
+                }
+                RUN_RESULT r = runEngine(engine, engine.points ? pointsPath : graphPath, scratch);
+                if(!r.ok)
+                {
+                    printf("%-10s %9lld %10lld %-10s %s\n", name.c_str(), n, m, engine.name, r.timeout ? "timeout" : "failed");
+                    continue;
+                }
+                // the euclidean tree spans the complete geometric graph, so it isn't comparable
+                bool differs = false;
+                if(!engine.points)
+                {
+                    if(reference.empty())
+                        reference = r.output;
+                    differs = r.output != reference;
+                }
+                printf("%-10s %9lld %10lld %-10s %10.4f %12.0f %9s %12s %12s %s%s\n", name.c_str(), n, m, engine.name,
+                       r.seconds, m/std::max(r.seconds, 1e-9), peakMB(r).c_str(), counter(r.cacheMisses).c_str(),
+                       counter(r.cacheReferences).c_str(), r.output.c_str(), differs ? " *" : "");
+                fflush(stdout);
+            }
+        }
+    }
+
+    unlink(graphPath.c_str());
+    unlink(pointsPath.c_str());
+    unlink(scratch.c_str());
+    return 0;
+}
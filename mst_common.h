@@ -0,0 +1,609 @@
+//
+//  mst_common.h
+//  Algorithm
+//
+//  shared input handling for the minimum spanning tree programs (prim_mst.cpp, kruskal_mst.cpp)
+//  compile with -std=c++11 -pthread
+//
+//  the whole input is loaded at once (mmap for regular files, bulk reads for pipes)
+//  and split into chunks that are tokenized into one integer array by several threads:
+//  the first pass counts the integers of every chunk, the second parses them to their final offset
+//
+//  input layouts, repeated once per test case:
+//  - matrix: "n" followed by the n*n weights of the adjacency matrix (the original format)
+//  - edges:  "n m" followed by m triples "a b w" of 0-based vertices and weight
+//  input encodings:
+//  - text:   decimal integers separated by anything that is not a digit or '-'
+//  - binary: the same integer sequence stored as raw native-endian 32-bit ints
+//
+//  all test cases are indexed up front and solved concurrently by a pool of workers,
+//  each worker draws its scratch memory from its own arena and the results are printed in input order
+//
+//  command line: [-e] [-b] [-t threads] [input file]
+//  -e reads the edge list layout, -b reads the binary encoding, stdin is read when no file is given
+//  -t sets the number of threads for both parsing and solving, all cores by default
+//  -k clusters and -d threshold cut the single linkage dendrogram (kruskal_mst.cpp only)
+//  -c prints the minimum spanning forest after the weight of every test case:
+//     the number of components, the component label of every vertex in order of first appearance,
+//     then per component a line "vertices edges weight" followed by its tree edges "a b w",
+//     written with a<b and sorted by weight, then a, then b, so programs that find the same forest
+//     print the same text whatever order they accept the edges in
+//
+
+#ifndef MST_COMMON_H
+#define MST_COMMON_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+enum GraphLayout
+{
+    LAYOUT_MATRIX,
+    LAYOUT_EDGES
+};
+
+typedef struct _graph_options
+{
+    GraphLayout layout;
+    bool binary;
+    int threads;
+    const char* path;
+    bool forest;
+    // single linkage clustering, used by kruskal_mst.cpp
+    int clusters;
+    bool clusterByDistance;
+    int threshold;
+}GRAPH_OPTIONS;
+
+// all integers of the input, consumed test case by test case
+typedef struct _graph_input
+{
+    GraphLayout layout;
+    const int* tokens;
+    size_t count;
+    size_t pos;
+    std::vector<int> parsed;
+    std::vector<char> buffer;
+    void* mapping;
+    size_t mappingSize;
+}GRAPH_INPUT;
+
+// one test case, pointing into the token array
+// matrix layout: data holds n*n weights, row after row
+// edges layout: data holds m triples of a, b, weight
+typedef struct _graph_instance
+{
+    int n;
+    int m;
+    const int* data;
+}GRAPH_INSTANCE;
+
+// bump allocator for the scratch memory of one test case
+// allocating moves an offset inside the current block and resetting makes all of it reusable,
+// so nothing is freed or cleared between test cases and workers never contend in malloc
+// when a test case outgrows the block, more blocks are chained and merged into one at the next reset
+typedef struct _arena
+{
+    std::vector<char*> blocks;
+    std::vector<size_t> sizes;
+    size_t used;        // bytes used in the last block
+    size_t total;       // bytes of all blocks
+    ~_arena()
+    {
+        for(size_t i=0; i<blocks.size(); ++i)
+            free(blocks[i]);
+    }
+}ARENA;
+
+inline void* arenaAlloc(ARENA& arena, size_t bytes, size_t align)
+{
+    if(!arena.blocks.empty())
+    {
+        size_t offset = (arena.used+align-1) & ~(align-1);
+        if(offset+bytes <= arena.sizes.back())
+        {
+            arena.used = offset+bytes;
+            return arena.blocks.back()+offset;
+        }
+    }
+    // malloc alignment covers every scratch type, so a new block starts at offset 0
+    size_t size = std::max(bytes, std::max(arena.total, (size_t)1<<16));
+    char* block = (char*)malloc(size);
+    if(block == NULL)
+    {
+        fprintf(stderr, "error: out of memory\n");
+        exit(1);
+    }
+    arena.blocks.push_back(block);
+    arena.sizes.push_back(size);
+    arena.total += size;
+    arena.used = bytes;
+    return block;
+}
+
+inline void arenaReset(ARENA& arena)
+{
+    if(arena.blocks.size() > 1)
+    {
+        size_t size = arena.total;
+        for(size_t i=0; i<arena.blocks.size(); ++i)
+            free(arena.blocks[i]);
+        arena.blocks.clear();
+        arena.sizes.clear();
+        arena.total = 0;
+        arena.used = 0;
+        arenaAlloc(arena, size, 1);
+    }
+    arena.used = 0;
+}
+
+// uninitialized array of count elements, only for trivially copyable types
+template <typename T>
+T* arenaArray(ARENA& arena, size_t count)
+{
+    return (T*)arenaAlloc(arena, count*sizeof(T), alignof(T));
+}
+
+// run fn(i) for i in [0, count) on the given number of threads
+// each thread takes a contiguous range, which suits the equally sized input chunks
+template <typename FN>
+void parallelFor(int count, int threads, FN fn)
+{
+    if(threads > count)
+        threads = count;
+    if(threads <= 1)
+    {
+        for(int i=0; i<count; ++i)
+            fn(i);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for(int t=0; t<threads; ++t)
+    {
+        int begin = (int)((long long)count*t/threads);
+        int end = (int)((long long)count*(t+1)/threads);
+        workers.push_back(std::thread([=]() {
+            for(int i=begin; i<end; ++i)
+                fn(i);
+        }));
+    }
+    for(size_t t=0; t<workers.size(); ++t)
+        workers[t].join();
+}
+
+// run fn(i) for i in [0, count) on a pool of threads
+// workers claim the next unsolved job from a shared counter rather than a fixed range,
+// so a few large test cases among many small ones don't leave the other workers idle
+template <typename FN>
+void workerPool(int count, int threads, FN fn)
+{
+    std::atomic<int> next(0);
+    auto work = [&]() {
+        for(int i=next++; i<count; i=next++)
+            fn(i);
+    };
+    if(threads > count)
+        threads = count;
+    if(threads <= 1)
+    {
+        work();
+        return;
+    }
+    std::vector<std::thread> workers;
+    for(int t=1; t<threads; ++t)
+        workers.push_back(std::thread(work));
+    work();
+    for(size_t t=0; t<workers.size(); ++t)
+        workers[t].join();
+}
+
+inline void parseGraphOptions(int argc, const char * argv[], GRAPH_OPTIONS& opts)
+{
+    opts.layout = LAYOUT_MATRIX;
+    opts.binary = false;
+    opts.threads = std::thread::hardware_concurrency();
+    opts.path = NULL;
+    opts.forest = false;
+    opts.clusters = 0;
+    opts.clusterByDistance = false;
+    opts.threshold = 0;
+    if(opts.threads < 1)
+        opts.threads = 1;
+
+    for(int i=1; i<argc; ++i)
+    {
+        if(strcmp(argv[i], "-e") == 0)
+            opts.layout = LAYOUT_EDGES;
+        else if(strcmp(argv[i], "-b") == 0)
+            opts.binary = true;
+        else if(strcmp(argv[i], "-c") == 0)
+            opts.forest = true;
+        else if(strcmp(argv[i], "-t") == 0 && i+1 < argc)
+            opts.threads = atoi(argv[++i]) > 0 ? atoi(argv[i]) : 1;
+        else if(strcmp(argv[i], "-k") == 0 && i+1 < argc)
+            opts.clusters = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-d") == 0 && i+1 < argc)
+        {
+            opts.clusterByDistance = true;
+            opts.threshold = atoi(argv[++i]);
+        }
+        // other flags belong to the program
+        else if(argv[i][0] != '-')
+            opts.path = argv[i];
+    }
+}
+
+// characters that can be part of an integer token
+static inline bool isTokenChar(char c)
+{
+    return (c>='0' && c<='9') || c=='-';
+}
+
+// scan the integers in [p, end), storing them to out unless it's NULL
+// counting and parsing share this function so both passes agree on the tokens
+inline size_t scanTokens(const char* p, const char* end, int* out)
+{
+    size_t num = 0;
+    while(p < end)
+    {
+        // skip separators
+        while(p<end && !isTokenChar(*p))
+            ++p;
+        if(p == end)
+            break;
+        bool negative = false;
+        if(*p == '-')
+        {
+            negative = true;
+            ++p;
+        }
+        // a lone '-' is not a number
+        if(p==end || *p<'0' || *p>'9')
+            continue;
+        int value = 0;
+        while(p<end && *p>='0' && *p<='9')
+        {
+            value = value*10 + (*p-'0');
+            ++p;
+        }
+        if(out)
+            out[num] = negative ? -value : value;
+        ++num;
+    }
+    return num;
+}
+
+// characters that can be part of a real number token
+static inline bool isRealChar(char c)
+{
+    return (c>='0' && c<='9') || c=='-' || c=='+' || c=='.' || c=='e' || c=='E';
+}
+
+// scan the real numbers in [p, end) like scanTokens
+// written out instead of strtod, which could read past the end of a mapped file
+inline size_t scanReals(const char* p, const char* end, double* out)
+{
+    size_t num = 0;
+    while(p < end)
+    {
+        // skip separators, a number starts with a sign, a digit or a dot
+        while(p<end && !((*p>='0' && *p<='9') || *p=='-' || *p=='+' || *p=='.'))
+            ++p;
+        if(p == end)
+            break;
+        bool negative = false;
+        if(*p=='-' || *p=='+')
+        {
+            negative = *p=='-';
+            ++p;
+        }
+        double mantissa = 0.0;
+        int exponent = 0;
+        bool digits = false;
+        while(p<end && *p>='0' && *p<='9')
+        {
+            mantissa = mantissa*10 + (*p-'0');
+            digits = true;
+            ++p;
+        }
+        if(p<end && *p=='.')
+        {
+            for(++p; p<end && *p>='0' && *p<='9'; ++p)
+            {
+                mantissa = mantissa*10 + (*p-'0');
+                --exponent;
+                digits = true;
+            }
+        }
+        if(!digits)
+            continue;
+        if(p<end && (*p=='e' || *p=='E'))
+        {
+            const char* q = p+1;
+            bool expNegative = false;
+            if(q<end && (*q=='-' || *q=='+'))
+            {
+                expNegative = *q=='-';
+                ++q;
+            }
+            if(q<end && *q>='0' && *q<='9')
+            {
+                int e = 0;
+                for(; q<end && *q>='0' && *q<='9'; ++q)
+                    e = e*10 + (*q-'0');
+                exponent += expNegative ? -e : e;
+                p = q;
+            }
+        }
+        double value = exponent<0 ? mantissa/pow(10.0, -exponent) : mantissa*pow(10.0, exponent);
+        if(out)
+            out[num] = negative ? -value : value;
+        ++num;
+    }
+    return num;
+}
+
+// tokenize the text in parallel with scan, which is scanTokens or scanReals
+// chunk boundaries are moved forward past number characters so that no number is split
+template <typename T, typename SCAN>
+void tokenize(const char* text, size_t size, int threads, std::vector<T>& out, SCAN scan)
+{
+    int chunks = threads;
+    if(size < (size_t)chunks*(1<<16))
+        chunks = (int)(size>>16) + 1;
+    std::vector<size_t> bounds(chunks+1);
+    bounds[0] = 0;
+    bounds[chunks] = size;
+    for(int i=1; i<chunks; ++i)
+    {
+        size_t b = size/chunks*i;
+        if(b < bounds[i-1])
+            b = bounds[i-1];
+        while(b<size && isRealChar(text[b]))
+            ++b;
+        bounds[i] = b;
+    }
+
+    // first pass: count the integers of every chunk
+    std::vector<size_t> offsets(chunks+1, 0);
+    parallelFor(chunks, threads, [&](int i) {
+        offsets[i+1] = scan(text+bounds[i], text+bounds[i+1], (T*)NULL);
+    });
+    for(int i=0; i<chunks; ++i)
+        offsets[i+1] += offsets[i];
+
+    // second pass: parse every chunk to its final offset
+    out.resize(offsets[chunks]);
+    T* base = out.data();
+    parallelFor(chunks, threads, [&](int i) {
+        scan(text+bounds[i], text+bounds[i+1], base+offsets[i]);
+    });
+}
+
+// map or read the whole input, the bytes stay valid until closeGraphInput
+// return false if the input can't be opened
+inline bool loadGraphBytes(const GRAPH_OPTIONS& opts, GRAPH_INPUT& in, const char*& bytes, size_t& size)
+{
+    in.layout = opts.layout;
+    in.tokens = NULL;
+    in.count = 0;
+    in.pos = 0;
+    in.mapping = NULL;
+    in.mappingSize = 0;
+
+    int fd = opts.path ? open(opts.path, O_RDONLY) : fileno(stdin);
+    if(fd < 0)
+    {
+        fprintf(stderr, "error: can't open %s\n", opts.path);
+        return false;
+    }
+
+    bytes = NULL;
+    size = 0;
+    struct stat st;
+
+    // map regular files, which also covers redirected stdin
+    if(fstat(fd, &st)==0 && S_ISREG(st.st_mode) && st.st_size>0)
+    {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED)
+        {
+            madvise(p, st.st_size, MADV_SEQUENTIAL);
+            in.mapping = p;
+            in.mappingSize = st.st_size;
+            bytes = (const char*)p;
+            size = st.st_size;
+        }
+    }
+    // otherwise read the stream in large blocks
+    if(bytes == NULL)
+    {
+        size_t got;
+        do
+        {
+            in.buffer.resize(size + (1<<20));
+            got = read(fd, in.buffer.data()+size, 1<<20);
+            if(got != (size_t)-1)
+                size += got;
+        }while(got != 0 && got != (size_t)-1);
+        in.buffer.resize(size);
+        bytes = in.buffer.data();
+    }
+    if(opts.path)
+        close(fd);
+    return true;
+}
+
+// release the text once it has been tokenized
+inline void releaseGraphBytes(GRAPH_INPUT& in)
+{
+    if(in.mapping)
+    {
+        munmap(in.mapping, in.mappingSize);
+        in.mapping = NULL;
+    }
+    std::vector<char>().swap(in.buffer);
+}
+
+// load the whole input and turn it into integers
+// return false if the input can't be opened
+inline bool openGraphInput(const GRAPH_OPTIONS& opts, GRAPH_INPUT& in)
+{
+    const char* bytes;
+    size_t size;
+    if(!loadGraphBytes(opts, in, bytes, size))
+        return false;
+
+    if(opts.binary)
+    {
+        // both mmap and vector storage are aligned well enough for int
+        in.tokens = (const int*)bytes;
+        in.count = size/sizeof(int);
+    }
+    else
+    {
+        tokenize(bytes, size, opts.threads, in.parsed, scanTokens);
+        in.tokens = in.parsed.data();
+        in.count = in.parsed.size();
+        releaseGraphBytes(in);
+    }
+    return true;
+}
+
+// load the whole text input as real numbers, for inputs such as point coordinates
+inline bool readRealInput(const GRAPH_OPTIONS& opts, std::vector<double>& values)
+{
+    GRAPH_INPUT in;
+    const char* bytes;
+    size_t size;
+    if(!loadGraphBytes(opts, in, bytes, size))
+        return false;
+    tokenize(bytes, size, opts.threads, values, scanReals);
+    releaseGraphBytes(in);
+    return true;
+}
+
+inline void closeGraphInput(GRAPH_INPUT& in)
+{
+    if(in.mapping)
+        munmap(in.mapping, in.mappingSize);
+    in.mapping = NULL;
+    in.tokens = NULL;
+    in.count = 0;
+}
+
+// get the next single integer, for programs that read extra data after a test case
+inline bool nextGraphInt(GRAPH_INPUT& in, int& value)
+{
+    if(in.pos >= in.count)
+        return false;
+    value = in.tokens[in.pos++];
+    return true;
+}
+
+// get the next test case
+// return false at the end of input, or when the last test case is truncated
+inline bool nextGraphInstance(GRAPH_INPUT& in, GRAPH_INSTANCE& g)
+{
+    if(in.pos >= in.count)
+        return false;
+    g.n = in.tokens[in.pos++];
+    if(g.n < 0)
+        return false;
+    size_t need;
+    if(in.layout == LAYOUT_MATRIX)
+    {
+        g.m = 0;
+        need = (size_t)g.n*g.n;
+    }
+    else
+    {
+        if(in.pos >= in.count)
+            return false;
+        g.m = in.tokens[in.pos++];
+        if(g.m < 0)
+            return false;
+        need = (size_t)g.m*3;
+    }
+    if(in.count-in.pos < need)
+        return false;
+    g.data = in.tokens+in.pos;
+    in.pos += need;
+    return true;
+}
+
+// write the spanning forest in the -c format
+// label holds the component of every vertex, tree holds edges with members a, b and dis
+template <typename EDGE_T>
+void writeForest(int n, int comps, const int* label, const EDGE_T* tree, int treeCount, std::string& out)
+{
+    char line[64];
+    std::vector<int> vertices(comps, 0);
+    std::vector<int> edges(comps, 0);
+    std::vector<long long> weight(comps, 0);
+    for(int i=0; i<n; ++i)
+        vertices[label[i]]++;
+    for(int i=0; i<treeCount; ++i)
+    {
+        edges[label[tree[i].a]]++;
+        weight[label[tree[i].a]] += tree[i].dis;
+    }
+
+    snprintf(line, sizeof(line), "%d\n", comps);
+    out += line;
+    for(int i=0; i<n; ++i)
+    {
+        snprintf(line, sizeof(line), i ? " %d" : "%d", label[i]);
+        out += line;
+    }
+    out += "\n";
+
+    // group the tree edges by component, then sort every group by (weight, a, b) with a<b
+    std::vector<int> start(comps+1, 0);
+    for(int c=0; c<comps; ++c)
+        start[c+1] = start[c]+edges[c];
+    std::vector<int> order(treeCount);
+    std::vector<int> fill(start.begin(), start.end()-1);
+    for(int i=0; i<treeCount; ++i)
+        order[fill[label[tree[i].a]]++] = i;
+    auto key = [&](int i) {
+        return std::make_pair(tree[i].dis, std::make_pair(std::min(tree[i].a, tree[i].b), std::max(tree[i].a, tree[i].b)));
+    };
+    for(int c=0; c<comps; ++c)
+        std::sort(order.begin()+start[c], order.begin()+start[c+1], [&](int x, int y) { return key(x) < key(y); });
+
+    size_t pos = 0;
+    for(int c=0; c<comps; ++c)
+    {
+        snprintf(line, sizeof(line), "%d %d %lld\n", vertices[c], edges[c], weight[c]);
+        out += line;
+        for(int e=0; e<edges[c]; ++e, ++pos)
+        {
+            const EDGE_T& edge = tree[order[pos]];
+            snprintf(line, sizeof(line), "%d %d %d\n", std::min(edge.a, edge.b), std::max(edge.a, edge.b), edge.dis);
+            out += line;
+        }
+    }
+}
+
+// index every remaining test case so they can be solved in any order
+inline void collectGraphInstances(GRAPH_INPUT& in, std::vector<GRAPH_INSTANCE>& instances)
+{
+    GRAPH_INSTANCE g;
+    while(nextGraphInstance(in, g))
+        instances.push_back(g);
+}
+
+#endif
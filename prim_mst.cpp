@@ -5,34 +5,83 @@
 //  Created by Ray Shen on 2015-01-31.
 //
 //  Implemented Prim's algorithm for finding minimum spanning tree in a weighted undirected graph.
+//  A disconnected graph gets a minimum spanning forest: when no vertex is reachable from the
+//  current tree, the next tree starts at the first unused vertex.
+//
+//  Input is read in bulk by mst_common.h, either as adjacency matrices or as edge lists.
+//  Test cases are solved in parallel, so the working arrays are per thread
+//  and come from the arena of the thread, which is reset between test cases.
 // 
 
 #include <cstdio>
 #include <cstring>
+#include <climits>
+#include <vector>
+#include <string>
+#include "mst_common.h"
 
-#define INF 1000000;
+// distance of a vertex no tree vertex has an edge to, no int weight can reach it
+#define INF LLONG_MAX
 
-int ret, n;
-bool used[100];
-int dis[100];
-int map[100][100];
+typedef struct edge
+{
+    int a;
+    int b;
+    int dis;
+}EDGE;
+
+thread_local ARENA arena;
+thread_local long long ret;
+thread_local int n;
+thread_local char* used;
+thread_local long long* dis;
+// tree vertex that dis[j] comes from
+thread_local int* from;
+// component of every vertex, and tree edges in the order they were added
+thread_local int* label;
+thread_local int comps;
+thread_local EDGE* tree;
+thread_local int treenum;
+// n*n weights row after row, pointing into the input or into a matrix built in the arena
+thread_local const int* map;
+// n*n flags of the edges present in an edge list, NULL for the matrix layout where every pair is an edge
+thread_local const char* present;
+
+// weight of the edge between the row vertex and j, INF without an edge
+static inline long long weight(const int* row, const char* rowPresent, int j)
+{
+    return rowPresent && !rowPresent[j] ? INF : row[j];
+}
 
 
 void prim()
 {
-    int i, j, k, min;
-    memset(used, 0, sizeof(used));
+    int i, j, k;
+    long long min;
+    const int* row;
+    const char* rowPresent;
+    if(n == 0)
+        return;
+    used = arenaArray<char>(arena, n);
+    dis = arenaArray<long long>(arena, n);
+    from = arenaArray<int>(arena, n);
+    label = arenaArray<int>(arena, n);
+    tree = arenaArray<EDGE>(arena, n);
     
     for(i=0; i<n; i++)
     {
-        dis[i] = map[0][i];
+        dis[i] = weight(map, present, i);
+        used[i] = false;
+        from[i] = 0;
     }
     used[0] = true;
+    label[0] = 0;
+    comps = 1;
     
     for(i=1; i<n; i++)
     {
         min = INF;
-        k = 0;
+        k = -1;
         for(j=0; j<n; j++)
         {
             if(!used[j] && dis[j]<min)
@@ -41,33 +90,106 @@ void prim()
                 k = j;
             }
         }
-        ret += min;
+        if(k == -1)
+        {
+            // nothing left is reachable, start the tree of the next component
+            for(k=0; used[k]; k++)
+                ;
+            label[k] = comps++;
+        }
+        else
+        {
+            ret += min;
+            label[k] = label[from[k]];
+            EDGE e = {from[k], k, (int)min};
+            tree[treenum++] = e;
+        }
         used[k] = true;
+        row = map + (size_t)k*n;
+        rowPresent = present ? present + (size_t)k*n : NULL;
         for(j=0; j<n; j++)
         {
-            if(!used[j] && dis[j]>map[k][j])
+            long long w = weight(row, rowPresent, j);
+            if(!used[j] && dis[j]>w)
             {
-                dis[j] = map[k][j];
+                dis[j] = w;
+                from[j] = k;
             }
         }
     }
 }
 
-int main(int argc, const char * argv[]) {
-    int i, j;
-    while(scanf("%d", &n)!=EOF)
+// build the adjacency matrix of an edge list test case
+// missing edges are flagged in present, so every int is a valid weight, and parallel edges keep the lightest weight
+void buildMatrix(const GRAPH_INSTANCE& g)
+{
+    int i, a, b, w;
+    size_t size = (size_t)g.n*g.n;
+    int* dense = arenaArray<int>(arena, size);
+    char* flags = arenaArray<char>(arena, size);
+    memset(flags, 0, size);
+    for(i=0; i<g.n; i++)
     {
-        ret = 0;
-        for(i=0; i<n; i++)
+        dense[(size_t)i*g.n+i] = 0;
+        flags[(size_t)i*g.n+i] = 1;
+    }
+    for(i=0; i<g.m; i++)
+    {
+        a = g.data[3*i];
+        b = g.data[3*i+1];
+        w = g.data[3*i+2];
+        if(a<0 || a>=g.n || b<0 || b>=g.n)
+            continue;
+        if(!flags[(size_t)a*g.n+b] || w < dense[(size_t)a*g.n+b])
         {
-            for(j=0; j<n; j++)
-            {
-                scanf("%d", &map[i][j]);
-            }
+            dense[(size_t)a*g.n+b] = w;
+            dense[(size_t)b*g.n+a] = w;
+            flags[(size_t)a*g.n+b] = 1;
+            flags[(size_t)b*g.n+a] = 1;
         }
-        prim();
-        printf("%d\n", ret);
     }
+    map = dense;
+    present = flags;
+}
+
+// solve one test case with the scratch arena of the calling thread
+long long solve(const GRAPH_INSTANCE& g, GraphLayout layout, const GRAPH_OPTIONS& opts, std::string& out)
+{
+    arenaReset(arena);
+    n = g.n;
+    ret = 0;
+    treenum = 0;
+    present = NULL;
+    if(layout == LAYOUT_MATRIX)
+        map = g.data;
+    else
+        buildMatrix(g);
+    prim();
+    if(opts.forest)
+        writeForest(n, n ? comps : 0, label, tree, treenum, out);
+    return ret;
+}
+
+int main(int argc, const char * argv[]) {
+    GRAPH_OPTIONS opts;
+    GRAPH_INPUT in;
+    std::vector<GRAPH_INSTANCE> instances;
+    parseGraphOptions(argc, argv, opts);
+    if(!openGraphInput(opts, in))
+        return 1;
+    collectGraphInstances(in, instances);
+    
+    std::vector<long long> results(instances.size());
+    std::vector<std::string> forests(instances.size());
+    workerPool((int)instances.size(), opts.threads, [&](int i) {
+        results[i] = solve(instances[i], in.layout, opts, forests[i]);
+    });
+    for(size_t i=0; i<results.size(); i++)
+    {
+        printf("%lld\n", results[i]);
+        fputs(forests[i].c_str(), stdout);
+    }
+    closeGraphInput(in);
     
     return 0;
 }
@@ -8,23 +8,24 @@
 //  by transforming in-fix notation into reverse-Polish notation using stack.
 //
 //  Docode the transformed string using recognition pattern based on logical operation symbols.
+//
+//  The parser and the evaluation engines are in shunting_yard.h. Besides the expression, every
+//  engine is run on it and compared: bytecode, simplification, truth table, short-circuit evaluation,
+//  a rule set with the rest of the input as further rules, and a record file if one is given.
+//  command line: [records file [threads]], the records selected by the expression are counted
 // 
 
 #include <string>
-#include <map>
-#include <stack>
+#include <vector>
 #include <iostream>
+#include <iterator>
 #include <stdlib.h>
+#include <stdint.h>
+#include "shunting_yard.h"
 
 using namespace std;
 
 
-// context consist of string name and boolean value
-typedef map<string, bool> con_map;
-// operator consist of char name and integer precedence
-typedef map<char, int> opt_map;
-
-
 // initialize expression, contexts, and operators
 void initialize(string& _exp, con_map& _con, opt_map& _opt)
 {
@@ -49,176 +50,21 @@ void handle_error(const char* _msg)
     exit(0);
 }
 
-// move forward the iterator and return the variable string without " symbol
-// promp out notice and exit if there's error
-string get_var(unsigned int& _i, string& _str)
+// print out the error of a status with its position and exit program if there is one
+void check_status(const status& _err)
 {
-    // initialize return string to be empty
-    string _ret = "";
-    // loop until hit another " symbol
-    for(++_i; _i<_str.size(); ++_i)
-    {
-        if(_str[_i] == '\"')
-            break;
-        _ret += _str[_i];
-    }
-    // if there is error
-    if(_i == _str.size())
-        handle_error("variable not closed by \" symbol");
-    // return variable string surrounded by " symbols
-    return _ret;
+    if(_err.code == ERR_NONE)
+        return;
+    cout << "error: " << error_message(_err.code) << " at position " << _err.pos << endl;
+    exit(0);
 }
 
-// append the top item of the stack to the string and pop out that item
-void stack_to_string(string& _str, stack<char>& _stk)
-{
-    _str += _stk.top();
-    _stk.pop();
-}
+#if __cplusplus >= 201703L
+// the default expression of initialize, parsed by the compiler
+constexpr auto default_rule = parse_static("(\"A\"&\"B\")^(\"C\"|~\"D\")");
+#endif
 
-// get in-fix expression as input
-// return post-fix expression
-string shuntingYard(string& _exp, opt_map& _opt)
-{
-    stack<char> _opt_stack;
-    string _ret = "";
-    string _var = "";
-
-    // loop each character of the expression string
-    for(unsigned int _i=0; _i<_exp.size(); ++_i)
-    {
-        switch(_exp[_i])
-        {
-        // the token is a variable
-        case '\"':
-            // get the variable string
-            _var = get_var(_i, _exp);
-            // append the variable to return string
-            _ret.append("\""+_var+"\"");
-            break;
-        // the token is a operator
-        case '&':
-        case '|':
-        case '~':
-        case '^':
-            // if there's operator in stack with precedence higher than or equal to the new operator
-            while(!_opt_stack.empty() && _opt[_opt_stack.top()] >= _opt[_exp[_i]])
-                stack_to_string(_ret, _opt_stack);
-            // push the new operator to stack anyway
-            _opt_stack.push(_exp[_i]);
-            break;
-        // the token is a left parenthesis
-        case '(':
-            // push left parenthesis to stack
-            _opt_stack.push(_exp[_i]);
-            break;
-        // the token is a right parenthesis
-        case ')':
-            // pop all operators between the two parenthesis to output string
-            while(_opt_stack.size() && _opt_stack.top()!='(')
-                stack_to_string(_ret, _opt_stack);
-            // error if there's no right parenthesis left
-            if(_opt_stack.empty())
-                handle_error("mismatched right parenthesis");
-            // pop out the right parenthesis
-            _opt_stack.pop();
-            break;
-        }
-    }
-
-    // no more tokens to read
-    while(!_opt_stack.empty())
-    {
-        // error if left parenthesis still exist
-        if(_opt_stack.top() == '(')
-            handle_error("mismatched left parenthesis");
-        // pop to return string
-        stack_to_string(_ret, _opt_stack);
-    }
-
-    // return the post-fix expression
-    return _ret;
-}
-
-bool evaluate(string& _pf, con_map& _ct)
-{
-    stack<bool> _val_stack;
-    bool _ret = false;
-    string _var = "";
-    bool _tmp1, _tmp2;
-
-    // loop each character of the post-fix string
-    for(unsigned int _i=0; _i<_pf.size(); ++_i)
-    {
-        switch(_pf[_i])
-        {
-        // the token is a variable
-        case '\"':
-            // get the variable string
-            _var = get_var(_i, _pf);
-            // push the value of the variable into stack
-            _val_stack.push(_ct[_var]);
-            break;
-        // the token is a AND operator
-        case '&':
-            // error if less than two values in the stack
-            if(_val_stack.size() < 2)
-                handle_error("variables for AND operator mismatched");
-            // pop the top two values in the stack and push in their AND value
-            _tmp1 = _val_stack.top();
-            _val_stack.pop();
-            _tmp2 = _val_stack.top();
-            _val_stack.pop();
-            _val_stack.push(_tmp1&_tmp2);
-            break;
-        // the token is a OR operator
-        case '|':
-            // error if less than two values in the stack
-            if(_val_stack.size() < 2)
-                handle_error("variables for AND operator mismatched");
-            // pop the top two values in the stack and push in their OR value
-            _tmp1 = _val_stack.top();
-            _val_stack.pop();
-            _tmp2 = _val_stack.top();
-            _val_stack.pop();
-            _val_stack.push(_tmp1|_tmp2);
-            break;
-        // the token is a NOT operator
-        case '~':
-            // error if less than one values in the stack
-            if(_val_stack.size() < 1)
-                handle_error("variables for AND operator mismatched");
-            // pop the top value in the stack and push in its NOT value
-            _tmp1 = _val_stack.top();
-            _val_stack.pop();
-            _val_stack.push(!_tmp1);
-            break;
-        // the token is a XOR operator
-        case '^':
-            // error if less than two values in the stack
-            if(_val_stack.size() < 2)
-                handle_error("variables for AND operator mismatched");
-            // pop the top two values in the stack and push in their XOR value
-            _tmp1 = _val_stack.top();
-            _val_stack.pop();
-            _tmp2 = _val_stack.top();
-            _val_stack.pop();
-            _val_stack.push(_tmp1^_tmp2);
-            break;
-        }
-    }
-
-    // should be only one value left in the stack
-    if(_val_stack.size() != 1)
-        handle_error("operators and variables in post-fix string mismatched");
-
-    // get teh evaluated value of the post-fix string
-    _ret = _val_stack.top();
-
-    return _ret;
-}
-
-int main()
+int main(int argc, const char * argv[])
 {
     string _expression;
     con_map _context;
@@ -231,11 +77,140 @@ int main()
     for(con_map::iterator _i=_context.begin(); _i!=_context.end(); ++_i)
         cout << "  " << _i->first << " : " << _i->second << endl;
 
-    string _post_fix = shuntingYard(_expression, _operator);
+    string _post_fix;
+    check_status(shuntingYard(_expression, _operator, _post_fix));
     cout << "post-fix: " << _post_fix <<endl;
 
-    bool _result = evaluate(_post_fix, _context);
+    bool _result;
+    check_status(evaluate(_post_fix, _context, _result));
     cout << "result: " << _result << endl;
 
+    program _program;
+    vector<unsigned char> _values;
+    check_status(compile(_post_fix, _program));
+    bind_context(_program.slots, _context, _values);
+    cout << "compiled result: " << execute(_program, _values.data()) << endl;
+
+    // filter the records of a file with the expression
+    if(argc > 1)
+    {
+        batch_context _records;
+        vector<uint64_t> _selected;
+        int _threads = argc>2 ? atoi(argv[2]) : (int)thread::hardware_concurrency();
+        if(!load_columns(argv[1], _program.slots, _records))
+            handle_error("can't read record file");
+        filter_batch(_program, _records, _threads, _selected);
+        size_t _ones = 0;
+        for(size_t _w=0; _w<_selected.size(); ++_w)
+            _ones += __builtin_popcountll(_selected[_w]);
+        cout << "selected records: " << _ones << " of " << _records.count << endl;
+    }
+#if __cplusplus >= 201703L
+    unsigned char _static_values[default_rule.slots];
+    bind_static(default_rule, _context, _static_values);
+    cout << "default rule parsed at compile time: " << (evaluate_static<default_rule>(_static_values) & 1) << endl;
+#endif
+
+    // simplified form of the expression and its compiled size
+    symbol_table _symbols;
+    parser _simplify_parser;
+    vector<token> _simplified;
+    program _simplified_program;
+    check_status(parse_expression(_simplify_parser, _symbols, _expression.data(), _expression.size()));
+    check_status(simplify(_simplify_parser.rpn, _symbols, NULL, _simplified));
+    check_status(compile_rpn(_simplified, _symbols, _simplified_program));
+    cout << "simplified post-fix: " << rpn_to_string(_simplified, _symbols);
+    cout << " (" << _simplified_program.code.size() << " of " << _program.code.size() << " instructions)" << endl;
+
+    // evaluate every assignment of the variables as one batch into a truth table
+    truth_table _table;
+    if(build_truth_table(_program, _table))
+    {
+        size_t _ones = 0;
+        for(size_t _w=0; _w<_table.bits.size(); ++_w)
+            _ones += __builtin_popcountll(_table.bits[_w]);
+        cout << "truth table result: " << truth_lookup(_table, _values.data()) << endl;
+        cout << "satisfying assignments: " << _ones << " of " << (1<<_table.vars) << endl;
+    }
+
+    // short-circuit evaluation, then again with operands ordered by the profile of the first run
+    program _lazy;
+    cost_profile _profile;
+    vector<signed char> _known;
+    counted_context _counted = {&_context, &_program.slots, 0};
+    check_status(compile_short_circuit(_post_fix, NULL, _lazy));
+    init_profile(_lazy, _profile);
+    bool _lazy_result = execute_short_circuit(_lazy, counted_lookup, &_counted, _known, &_profile);
+    cout << "short-circuit result: " << _lazy_result << ", lookups: " << _counted.lookups << " of " << _lazy.slots.size() << endl;
+    _counted.lookups = 0;
+    check_status(compile_short_circuit(_post_fix, &_profile, _lazy));
+    _lazy_result = execute_short_circuit(_lazy, counted_lookup, &_counted, _known, NULL);
+    cout << "reordered result: " << _lazy_result << ", lookups: " << _counted.lookups << " of " << _lazy.slots.size() << endl;
+
+    // every further line read is a rule, compiled together with the first expression
+    // the rest of the input is parsed in place, line by line, and a rule with an error is skipped
+    rule_set _rules;
+    parser _parser;
+    string _text((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+    check_status(add_rule(_rules, _post_fix));
+    for(size_t _begin=0, _end; _begin<_text.size(); _begin=_end+1)
+    {
+        _end = _text.find('\n', _begin);
+        if(_end == string::npos)
+            _end = _text.size();
+        if(_text.find_first_not_of(" \t\r", _begin) < _end)
+        {
+            status _err = add_rule_text(_rules, _parser, _text.data()+_begin, _end-_begin);
+            if(_err.code != ERR_NONE)
+                cout << "skipped rule: " << error_message(_err.code) << " at position " << _err.pos << endl;
+        }
+    }
+    if(_rules.roots.size() > 1)
+    {
+        vector<unsigned char> _rule_values, _node_values, _rule_results;
+        bind_context(_rules.slots, _context, _rule_values);
+        execute_rules(_rules, _rule_values.data(), _node_values, _rule_results);
+        cout << "rules: " << _rules.roots.size() << ", shared nodes: " << _rules.nodes.size() << endl;
+        for(size_t _r=0; _r<_rules.roots.size(); ++_r)
+            cout << "  rule " << _r << " : " << (int)_rule_results[_r] << endl;
+
+        // rules with the same BDD node are equivalent, the false node is unsatisfiable
+        bdd _bdd;
+        vector<int> _bdd_roots;
+        init_bdd(_bdd, 1<<20);
+        if(build_bdd(_rules, _bdd, _bdd_roots))
+        {
+            cout << "  bdd nodes: " << _bdd.nodes.size() << endl;
+            for(size_t _r=0; _r<_rules.roots.size(); ++_r)
+            {
+                for(size_t _q=0; _q<_r; ++_q)
+                    if(_bdd_roots[_q] == _bdd_roots[_r])
+                    {
+                        cout << "  rule " << _r << " is equivalent to rule " << _q << endl;
+                        break;
+                    }
+                if(_bdd_roots[_r] == BDD_FALSE)
+                    cout << "  rule " << _r << " is unsatisfiable" << endl;
+            }
+        }
+
+        // flip every variable alone and report the rules that change with it
+        incremental_state _state;
+        vector<int> _changed;
+        init_incremental(_rules, _rule_values.data(), _state);
+        for(unsigned int _i=0; _i<_rules.slots.size(); ++_i)
+        {
+            _changed.clear();
+            set_variable(_state, _i, !_rule_values[_i]);
+            propagate(_rules, _state, _changed);
+            cout << "  flip " << _rules.slots[_i] << " changes rules:";
+            for(size_t _k=0; _k<_changed.size(); ++_k)
+                cout << " " << _changed[_k];
+            cout << endl;
+            set_variable(_state, _i, _rule_values[_i]);
+            propagate(_rules, _state, _changed);
+        }
+    }
+
     return 0;
 }
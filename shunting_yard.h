@@ -0,0 +1,2367 @@
+//
+//  shunting_yard.h
+//  Algorithm
+//
+//  Parser and evaluation engines for logical expressions, used by shunting_yard.cpp and measured by
+//  shunting_yard_benchmark.cpp.
+//  compile with -std=c++11 -pthread, the compile-time parser needs -std=c++17
+//
+//  The library is reentrant and never exits: it keeps no mutable global or static state, errors of parsing
+//  and compiling are returned as a status with an error code and the offset of the offending token
+//  in the source text, and no exception is thrown short of running out of memory.
+//  Compiled programs, rule sets, truth tables and BDDs are only read while evaluating, so one of them
+//  can be shared by any number of threads; scratch space, incremental state, cost profiles and parsers
+//  belong to one thread each.
+//
+
+//  For repeated evaluation the post-fix string is compiled once into bytecode, with every variable
+//  resolved to an integer slot, and run by a small stack machine with a fixed-size value stack,
+//  so evaluating against a new context needs no string work and no allocation.
+//
+//  The operators are all bitwise, so the same bytecode also evaluates a batch of contexts at once:
+//  every variable is stored as a bit column with one bit per context, and the stack machine runs
+//  on whole vector lanes of 256 or 512 bits (64 bit words for the tail), one pass per batch.
+//
+//  Many expressions are compiled together into a rule set: their post-fix forms are hash-consed
+//  into one DAG over shared variable slots, so a subexpression repeated across rules is a single
+//  node, evaluated once per context, and all rule results come out of one pass over the nodes.
+//
+//  When only a few variables of a context change, a rule set can be re-evaluated incrementally:
+//  node values are kept, and an index from every node to the nodes reading it lets a change
+//  propagate upwards in node order, stopping where a value doesn't change, so the work is
+//  proportional to the affected part of the DAG. The rules whose result flipped are reported.
+//
+//  For variables backed by expensive lookups an expression is compiled to short-circuit bytecode:
+//  AND and OR chains are flattened and jump over the remaining operands once the result is decided,
+//  and variables are looked up on demand, at most once per evaluation. Given a measured profile of
+//  the cost and the probability of being true of every variable, the operands of a chain are
+//  reordered so that cheap and decisive checks come first.
+//
+//  Rule text can also be parsed without building strings: the tokenizer returns typed tokens that
+//  point into the source buffer, variable names are interned into dense ids by an open addressing
+//  symbol table, and the shunting yard runs on the token array and produces a typed post-fix array,
+//  in linear time and without allocation once the scratch arrays have grown.
+//
+//  An expression over a few variables is precomputed into a truth table of one bit per assignment,
+//  filled by a single batch evaluation, so evaluating it is one indexed bit lookup. Larger ones and
+//  whole rule sets compile to a reduced ordered BDD, built bottom-up over the DAG with a unique table
+//  and a memoized apply, which evaluates in at most one step per variable. Equivalent rules get the
+//  same BDD node and an unsatisfiable rule is the false node, so both checks are free.
+//
+//  Between parsing and compiling, a typed post-fix array can be simplified: variables pinned in a
+//  context are folded into constants, AND, OR and XOR chains are flattened into n-ary nodes with
+//  sorted operands, and double negations, repeated and complementary operands, self-cancelling XOR
+//  terms and absorbed terms like a&(a|b) are removed, then a smaller post-fix array is emitted.
+//
+//  Rules fixed in source can be parsed by the compiler (C++17): parse_static turns a string literal
+//  into a fixed-size program in a constexpr, and evaluate_static expands that program at compile
+//  time into straight-line bitwise code, with no parsing at startup and no branches at run time.
+//
+//  Record tables are loaded straight into the bit columns of a batch, one column per variable, from
+//  CSV files with a header of variable names or from a binary file of packed columns, and filtered
+//  by a compiled expression chunk by chunk on several threads into a selection bitmap.
+//
+
+#ifndef SHUNTING_YARD_H
+#define SHUNTING_YARD_H
+
+#include <string>
+#include <map>
+#include <stack>
+#include <vector>
+#include <unordered_map>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+
+// context consist of string name and boolean value
+typedef std::map<std::string, bool> con_map;
+// operator consist of char name and integer precedence
+typedef std::map<char, int> opt_map;
+
+// bytecode operations of a compiled expression
+enum op_code
+{
+    OP_LOAD,    // push the value of a variable slot
+    OP_NOT,
+    OP_AND,
+    OP_OR,
+    OP_XOR,
+    OP_JUMP_FALSE,  // short-circuit only, jump if the top is false, pop it otherwise
+    OP_JUMP_TRUE,   // short-circuit only, jump if the top is true, pop it otherwise
+    OP_CONST        // push the constant 0 or 1, only left by the simplifier
+};
+
+// an instruction packs the operation into the low 3 bits and the variable slot or jump target above them
+typedef unsigned int instruction;
+#define OP_BITS 3
+#define OP_MASK 7
+
+// deepest value stack a compiled expression may need
+#define VM_STACK_SIZE 256
+
+// errors of parsing and compiling
+enum error_code
+{
+    ERR_NONE,
+    ERR_UNCLOSED_VARIABLE,
+    ERR_RIGHT_PARENTHESIS,  // right parenthesis without a left one
+    ERR_LEFT_PARENTHESIS,   // left parenthesis never closed
+    ERR_NOT_OPERANDS,       // NOT operator without an operand
+    ERR_BINARY_OPERANDS,    // binary operator without two operands
+    ERR_OPERANDS,           // operators and variables don't reduce to one value
+    ERR_TOO_DEEP,           // the value stack of a compiled expression would overflow
+    ERR_TOO_MANY_NODES      // a rule set ran out of node ids
+};
+
+// outcome of parsing or compiling, pos is the offset of the offending token in the source text
+typedef struct _status
+{
+    int code;
+    size_t pos;
+}status;
+
+// kinds of typed tokens, operators share the numbers of their operations
+enum token_kind
+{
+    TOK_VAR = OP_LOAD,
+    TOK_NOT = OP_NOT,
+    TOK_AND = OP_AND,
+    TOK_OR = OP_OR,
+    TOK_XOR = OP_XOR,
+    TOK_LEFT,
+    TOK_RIGHT,
+    TOK_CONST = OP_CONST    // constant with value id, never read from text
+};
+
+// precedence of every token kind, the same as initialize gives opt_map
+constexpr int token_precedence[] = {0, 3, 2, 2, 1, 0, 0, 0};
+
+// whether the operator _top on the stack goes to the output before _kind is pushed
+// binary operators are left-associative, the prefix NOT is right-associative so that ~~x is ~(~x)
+constexpr bool pops_before(int _top, int _kind)
+{
+    return token_precedence[_top] > token_precedence[_kind] || (token_precedence[_top] == token_precedence[_kind] && _kind != TOK_NOT);
+}
+
+// typed token, the text of a variable is the name between the quotes at pos
+typedef struct _token
+{
+    unsigned char kind;
+    int id;                 // interned id of a variable
+    unsigned int pos;       // offset of the token in the source text
+    unsigned int len;       // length of a variable name
+}token;
+
+// interns variable names into dense ids, open addressing with linear probing
+typedef struct _symbol_table
+{
+    std::vector<int> buckets;            // id+1 of the name in every bucket, 0 if empty, power of two size
+    std::vector<unsigned int> hashes;    // hash of every name by id
+    std::vector<unsigned int> starts;    // name of id i starts at text[starts[i]] and ends at the next start
+    std::string text;
+}symbol_table;
+
+// scratch arrays of parsing, kept between expressions so parsing doesn't allocate
+typedef struct _parser
+{
+    std::vector<token> tokens;
+    std::vector<token> rpn;
+    std::vector<token> ops;
+}parser;
+
+// compiled expression, variables are numbered into slots in order of first appearance
+typedef struct _program
+{
+    std::vector<instruction> code;
+    std::vector<std::string> slots;
+}program;
+
+// values of the slots of a compiled expression across many contexts
+// bit j of word w of a slot column is the value in context 64*w+j
+typedef struct _batch_context
+{
+    size_t count;               // number of contexts
+    size_t words;               // words per column, a whole number of lanes
+    std::vector<uint64_t> bits;      // slot columns one after another
+}batch_context;
+
+// widest word the batch evaluation works on, as a compiler vector so it maps to one AVX register
+// columns are only word aligned, so lanes are loaded with memcpy
+#if defined(__AVX512F__)
+typedef uint64_t lane __attribute__((vector_size(64)));
+#elif defined(__GNUC__)
+typedef uint64_t lane __attribute__((vector_size(32)));
+#else
+typedef uint64_t lane;
+#endif
+#define LANE_WORDS (sizeof(lane)/sizeof(uint64_t))
+
+// node of a rule set, identical subexpressions of all rules share one node
+typedef struct _dag_node
+{
+    unsigned char code;     // operation
+    int a;                  // slot of OP_LOAD, value of OP_CONST, first operand node otherwise
+    int b;                  // second operand node of binary operations
+}dag_node;
+
+// node ids and slots are packed into hash-consing keys of 29 bits each
+#define DAG_MAX_NODES (1<<29)
+
+// many expressions compiled into one DAG over shared variable slots
+// a node is always stored after its operands, so one pass in order evaluates every rule
+typedef struct _rule_set
+{
+    std::vector<dag_node> nodes;
+    std::vector<int> roots;                      // node of every rule
+    std::vector<std::string> slots;
+    symbol_table symbols;                   // slot of every variable name
+    std::unordered_map<uint64_t, int> unique;    // hash-consing table from (code, a, b) to node
+}rule_set;
+
+
+inline status make_status(int _code, size_t _pos)
+{
+    status _ret = {_code, _pos};
+    return _ret;
+}
+
+// message of an error code
+inline const char* error_message(int _code)
+{
+    switch(_code)
+    {
+    case ERR_NONE:
+        return "no error";
+    case ERR_UNCLOSED_VARIABLE:
+        return "variable not closed by \" symbol";
+    case ERR_RIGHT_PARENTHESIS:
+        return "mismatched right parenthesis";
+    case ERR_LEFT_PARENTHESIS:
+        return "mismatched left parenthesis";
+    case ERR_NOT_OPERANDS:
+        return "variables for NOT operator mismatched";
+    case ERR_BINARY_OPERANDS:
+        return "variables for binary operator mismatched";
+    case ERR_OPERANDS:
+        return "operators and variables in post-fix string mismatched";
+    case ERR_TOO_DEEP:
+        return "expression too deeply nested";
+    case ERR_TOO_MANY_NODES:
+        return "too many nodes in rule set";
+    }
+    return "unknown error";
+}
+
+// move forward the iterator to the closing " symbol and get the variable string without " symbols
+// return an error at the opening " symbol if there's no closing one
+inline status get_var(unsigned int& _i, const std::string& _str, std::string& _ret)
+{
+    size_t _open = _i;
+    // initialize return string to be empty
+    _ret = "";
+    // loop until hit another " symbol
+    for(++_i; _i<_str.size(); ++_i)
+    {
+        if(_str[_i] == '\"')
+            break;
+        _ret += _str[_i];
+    }
+    // if there is error
+    if(_i == _str.size())
+        return make_status(ERR_UNCLOSED_VARIABLE, _open);
+    return make_status(ERR_NONE, 0);
+}
+
+// append the top item of the stack to the string and pop out that item
+inline void stack_to_string(std::string& _str, std::stack<char>& _stk)
+{
+    _str += _stk.top();
+    _stk.pop();
+}
+
+// precedence of an operator, looked up without inserting so that a shared opt_map isn't written
+inline int precedence(const opt_map& _opt, char _c)
+{
+    opt_map::const_iterator _it = _opt.find(_c);
+    return _it!=_opt.end() ? _it->second : 0;
+}
+
+// get in-fix expression as input
+// return post-fix expression in _ret
+inline status shuntingYard(const std::string& _exp, const opt_map& _opt, std::string& _ret)
+{
+    std::stack<char> _opt_stack;
+    std::string _var = "";
+    status _err;
+    _ret = "";
+
+    // loop each character of the expression string
+    for(unsigned int _i=0; _i<_exp.size(); ++_i)
+    {
+        switch(_exp[_i])
+        {
+        // the token is a variable
+        case '\"':
+            // get the variable string
+            _err = get_var(_i, _exp, _var);
+            if(_err.code != ERR_NONE)
+                return _err;
+            // append the variable to return string
+            _ret.append("\""+_var+"\"");
+            break;
+        // the token is a operator
+        case '&':
+        case '|':
+        case '~':
+        case '^':
+            // if there's operator in stack with precedence higher than or equal to the new operator
+            // a NOT only pops higher ones, since it is a prefix of its operand
+            while(!_opt_stack.empty() && (precedence(_opt, _opt_stack.top()) > precedence(_opt, _exp[_i])
+                  || (precedence(_opt, _opt_stack.top()) == precedence(_opt, _exp[_i]) && _exp[_i] != '~')))
+                stack_to_string(_ret, _opt_stack);
+            // push the new operator to stack anyway
+            _opt_stack.push(_exp[_i]);
+            break;
+        // the token is a left parenthesis
+        case '(':
+            // push left parenthesis to stack
+            _opt_stack.push(_exp[_i]);
+            break;
+        // the token is a right parenthesis
+        case ')':
+            // pop all operators between the two parenthesis to output string
+            while(_opt_stack.size() && _opt_stack.top()!='(')
+                stack_to_string(_ret, _opt_stack);
+            // error if there's no right parenthesis left
+            if(_opt_stack.empty())
+                return make_status(ERR_RIGHT_PARENTHESIS, _i);
+            // pop out the right parenthesis
+            _opt_stack.pop();
+            break;
+        }
+    }
+
+    // no more tokens to read
+    while(!_opt_stack.empty())
+    {
+        // error if left parenthesis still exist, it is reported at the end of the expression
+        if(_opt_stack.top() == '(')
+            return make_status(ERR_LEFT_PARENTHESIS, _exp.size());
+        // pop to return string
+        stack_to_string(_ret, _opt_stack);
+    }
+
+    return make_status(ERR_NONE, 0);
+}
+
+// evaluate post-fix expression against a context into _ret
+// variables missing from the context are false
+inline status evaluate(const std::string& _pf, const con_map& _ct, bool& _ret)
+{
+    std::stack<bool> _val_stack;
+    std::string _var = "";
+    bool _tmp1, _tmp2;
+    con_map::const_iterator _it;
+    status _err;
+
+    // loop each character of the post-fix string
+    for(unsigned int _i=0; _i<_pf.size(); ++_i)
+    {
+        switch(_pf[_i])
+        {
+        // the token is a variable
+        case '\"':
+            // get the variable string
+            _err = get_var(_i, _pf, _var);
+            if(_err.code != ERR_NONE)
+                return _err;
+            // push the value of the variable into stack
+            _it = _ct.find(_var);
+            _val_stack.push(_it!=_ct.end() && _it->second);
+            break;
+        // the token is a AND operator
+        case '&':
+            // error if less than two values in the stack
+            if(_val_stack.size() < 2)
+                return make_status(ERR_BINARY_OPERANDS, _i);
+            // pop the top two values in the stack and push in their AND value
+            _tmp1 = _val_stack.top();
+            _val_stack.pop();
+            _tmp2 = _val_stack.top();
+            _val_stack.pop();
+            _val_stack.push(_tmp1&_tmp2);
+            break;
+        // the token is a OR operator
+        case '|':
+            // error if less than two values in the stack
+            if(_val_stack.size() < 2)
+                return make_status(ERR_BINARY_OPERANDS, _i);
+            // pop the top two values in the stack and push in their OR value
+            _tmp1 = _val_stack.top();
+            _val_stack.pop();
+            _tmp2 = _val_stack.top();
+            _val_stack.pop();
+            _val_stack.push(_tmp1|_tmp2);
+            break;
+        // the token is a NOT operator
+        case '~':
+            // error if less than one values in the stack
+            if(_val_stack.size() < 1)
+                return make_status(ERR_NOT_OPERANDS, _i);
+            // pop the top value in the stack and push in its NOT value
+            _tmp1 = _val_stack.top();
+            _val_stack.pop();
+            _val_stack.push(!_tmp1);
+            break;
+        // the token is a XOR operator
+        case '^':
+            // error if less than two values in the stack
+            if(_val_stack.size() < 2)
+                return make_status(ERR_BINARY_OPERANDS, _i);
+            // pop the top two values in the stack and push in their XOR value
+            _tmp1 = _val_stack.top();
+            _val_stack.pop();
+            _tmp2 = _val_stack.top();
+            _val_stack.pop();
+            _val_stack.push(_tmp1^_tmp2);
+            break;
+        }
+    }
+
+    // should be only one value left in the stack
+    if(_val_stack.size() != 1)
+        return make_status(ERR_OPERANDS, _pf.size());
+
+    // get teh evaluated value of the post-fix string
+    _ret = _val_stack.top();
+
+    return make_status(ERR_NONE, 0);
+}
+
+// FNV-1a hash of a name
+inline unsigned int hash_name(const char* _name, size_t _len)
+{
+    unsigned int _h = 2166136261u;
+    for(size_t _i=0; _i<_len; ++_i)
+        _h = (_h ^ (unsigned char)_name[_i]) * 16777619u;
+    return _h;
+}
+
+inline int symbol_count(const symbol_table& _table)
+{
+    return (int)_table.hashes.size();
+}
+
+// name of an interned id
+inline std::string symbol_name(const symbol_table& _table, int _id)
+{
+    size_t _end = _id+1<symbol_count(_table) ? _table.starts[_id+1] : _table.text.size();
+    return _table.text.substr(_table.starts[_id], _end-_table.starts[_id]);
+}
+
+// bucket holding a name, or the empty bucket where it belongs
+inline size_t find_bucket(const symbol_table& _table, const char* _name, size_t _len, unsigned int _h)
+{
+    size_t _mask = _table.buckets.size()-1;
+    for(size_t _b=_h&_mask; ; _b=(_b+1)&_mask)
+    {
+        int _id = _table.buckets[_b]-1;
+        if(_id == -1)
+            return _b;
+        if(_table.hashes[_id] != _h)
+            continue;
+        size_t _start = _table.starts[_id];
+        size_t _end = _id+1<symbol_count(_table) ? _table.starts[_id+1] : _table.text.size();
+        if(_end-_start==_len && memcmp(_table.text.data()+_start, _name, _len)==0)
+            return _b;
+    }
+}
+
+// id of a name, -1 if it was never interned
+inline int find_symbol(const symbol_table& _table, const char* _name, size_t _len)
+{
+    if(_table.buckets.empty())
+        return -1;
+    return _table.buckets[find_bucket(_table, _name, _len, hash_name(_name, _len))]-1;
+}
+
+// id of a name, the next free id if it is new
+// the table is kept at most half full
+inline int intern(symbol_table& _table, const char* _name, size_t _len)
+{
+    if(_table.buckets.empty())
+        _table.buckets.assign(64, 0);
+    unsigned int _h = hash_name(_name, _len);
+    size_t _b = find_bucket(_table, _name, _len, _h);
+    if(_table.buckets[_b] != 0)
+        return _table.buckets[_b]-1;
+
+    int _id = symbol_count(_table);
+    _table.hashes.push_back(_h);
+    _table.starts.push_back((unsigned int)_table.text.size());
+    _table.text.append(_name, _len);
+    _table.buckets[_b] = _id+1;
+    if(2*symbol_count(_table) > (int)_table.buckets.size())
+    {
+        // rehash into twice the buckets, with the stored hashes
+        std::vector<int> _old;
+        _old.swap(_table.buckets);
+        _table.buckets.assign(2*_old.size(), 0);
+        size_t _mask = _table.buckets.size()-1;
+        for(size_t _i=0; _i<_old.size(); ++_i)
+        {
+            if(_old[_i] == 0)
+                continue;
+            size_t _nb = _table.hashes[_old[_i]-1] & _mask;
+            while(_table.buckets[_nb] != 0)
+                _nb = (_nb+1) & _mask;
+            _table.buckets[_nb] = _old[_i];
+        }
+    }
+    return _id;
+}
+
+// split expression text, in-fix or post-fix, into typed tokens with interned variables
+// characters that aren't tokens are skipped, like in shuntingYard
+inline status tokenize(const char* _src, size_t _len, symbol_table& _table, std::vector<token>& _tokens)
+{
+    _tokens.clear();
+    for(size_t _i=0; _i<_len; ++_i)
+    {
+        token _tok = {0, -1, (unsigned int)_i, 0};
+        switch(_src[_i])
+        {
+        // the token is a variable, its name runs to the next " symbol
+        case '\"':
+        {
+            const char* _close = (const char*)memchr(_src+_i+1, '\"', _len-_i-1);
+            if(_close == NULL)
+                return make_status(ERR_UNCLOSED_VARIABLE, _i);
+            _tok.kind = TOK_VAR;
+            _tok.len = (unsigned int)(_close-_src-_i-1);
+            _tok.id = intern(_table, _src+_i+1, _tok.len);
+            _i = _close-_src;
+            break;
+        }
+        case '~':
+            _tok.kind = TOK_NOT;
+            break;
+        case '&':
+            _tok.kind = TOK_AND;
+            break;
+        case '|':
+            _tok.kind = TOK_OR;
+            break;
+        case '^':
+            _tok.kind = TOK_XOR;
+            break;
+        case '(':
+            _tok.kind = TOK_LEFT;
+            break;
+        case ')':
+            _tok.kind = TOK_RIGHT;
+            break;
+        default:
+            continue;
+        }
+        _tokens.push_back(_tok);
+    }
+    return make_status(ERR_NONE, 0);
+}
+
+// shunting yard over typed tokens, same precedences as initialize gives opt_map
+inline status parse_tokens(const std::vector<token>& _tokens, std::vector<token>& _rpn, std::vector<token>& _ops)
+{
+    _rpn.clear();
+    _ops.clear();
+    for(size_t _i=0; _i<_tokens.size(); ++_i)
+    {
+        const token& _tok = _tokens[_i];
+        switch(_tok.kind)
+        {
+        case TOK_VAR:
+            _rpn.push_back(_tok);
+            break;
+        case TOK_LEFT:
+            _ops.push_back(_tok);
+            break;
+        case TOK_RIGHT:
+            while(!_ops.empty() && _ops.back().kind!=TOK_LEFT)
+            {
+                _rpn.push_back(_ops.back());
+                _ops.pop_back();
+            }
+            if(_ops.empty())
+                return make_status(ERR_RIGHT_PARENTHESIS, _tok.pos);
+            _ops.pop_back();
+            break;
+        default:
+            while(!_ops.empty() && pops_before(_ops.back().kind, _tok.kind))
+            {
+                _rpn.push_back(_ops.back());
+                _ops.pop_back();
+            }
+            _ops.push_back(_tok);
+            break;
+        }
+    }
+    while(!_ops.empty())
+    {
+        if(_ops.back().kind == TOK_LEFT)
+            return make_status(ERR_LEFT_PARENTHESIS, _ops.back().pos);
+        _rpn.push_back(_ops.back());
+        _ops.pop_back();
+    }
+    return make_status(ERR_NONE, 0);
+}
+
+// parse in-fix expression text into the typed post-fix array _parser.rpn
+inline status parse_expression(parser& _parser, symbol_table& _table, const char* _src, size_t _len)
+{
+    status _err = tokenize(_src, _len, _table, _parser.tokens);
+    if(_err.code != ERR_NONE)
+        return _err;
+    return parse_tokens(_parser.tokens, _parser.rpn, _parser.ops);
+}
+
+// compile a typed post-fix array into bytecode
+// the stack effect of every instruction is checked here, so execute doesn't need to
+inline status compile_rpn(const std::vector<token>& _rpn, const symbol_table& _table, program& _prog)
+{
+    std::vector<int> _slot_of(symbol_count(_table), -1);
+    int _depth = 0;
+
+    _prog.code.clear();
+    _prog.slots.clear();
+    for(size_t _i=0; _i<_rpn.size(); ++_i)
+    {
+        const token& _tok = _rpn[_i];
+        switch(_tok.kind)
+        {
+        // the token is a variable, find its slot or give it the next one
+        case TOK_VAR:
+            if(_slot_of[_tok.id] == -1)
+            {
+                _slot_of[_tok.id] = (int)_prog.slots.size();
+                _prog.slots.push_back(symbol_name(_table, _tok.id));
+            }
+            _prog.code.push_back((instruction)_slot_of[_tok.id]<<OP_BITS | OP_LOAD);
+            if(++_depth > VM_STACK_SIZE)
+                return make_status(ERR_TOO_DEEP, _tok.pos);
+            break;
+        // the token is a constant
+        case TOK_CONST:
+            _prog.code.push_back((instruction)_tok.id<<OP_BITS | OP_CONST);
+            if(++_depth > VM_STACK_SIZE)
+                return make_status(ERR_TOO_DEEP, _tok.pos);
+            break;
+        // the token is a NOT operator
+        case TOK_NOT:
+            if(_depth < 1)
+                return make_status(ERR_NOT_OPERANDS, _tok.pos);
+            _prog.code.push_back(OP_NOT);
+            break;
+        // the token is a binary operator
+        case TOK_AND:
+        case TOK_OR:
+        case TOK_XOR:
+            if(_depth < 2)
+                return make_status(ERR_BINARY_OPERANDS, _tok.pos);
+            _prog.code.push_back(_tok.kind);
+            --_depth;
+            break;
+        }
+    }
+
+    // should be only one value left in the stack
+    if(_depth != 1)
+        return make_status(ERR_OPERANDS, _rpn.empty() ? 0 : _rpn.back().pos);
+    return make_status(ERR_NONE, 0);
+}
+
+// compile the post-fix string into bytecode, its tokens are already in post-fix order
+inline status compile(const std::string& _pf, program& _prog)
+{
+    symbol_table _table;
+    std::vector<token> _rpn;
+    status _err = tokenize(_pf.data(), _pf.size(), _table, _rpn);
+    if(_err.code != ERR_NONE)
+        return _err;
+    return compile_rpn(_rpn, _table, _prog);
+}
+
+// expression node of the simplifier, chains are n-ary with operands sorted by node
+typedef struct _expr_node
+{
+    unsigned char code;     // OP_LOAD, OP_CONST, OP_NOT, OP_AND, OP_OR or OP_XOR
+    int arg;                // symbol id of OP_LOAD, value of OP_CONST
+    std::vector<int> args;
+}expr_node;
+
+// hash-consed expression nodes, equal subexpressions are one node so operands compare by id
+typedef struct _simplifier
+{
+    std::vector<expr_node> nodes;
+    std::unordered_multimap<uint64_t, int> unique;  // hash of (code, arg, operands) to the nodes with it
+    std::vector<signed char> pinned;         // value of every symbol id fixed at compile time, -1 if free
+}simplifier;
+
+// FNV-1a over the code, argument and operands of a node
+inline uint64_t expr_hash(unsigned char _code, int _arg, const std::vector<int>& _args)
+{
+    uint64_t _h = 14695981039346656037ull;
+    _h = (_h ^ _code) * 1099511628211ull;
+    _h = (_h ^ (uint32_t)_arg) * 1099511628211ull;
+    for(size_t _i=0; _i<_args.size(); ++_i)
+        _h = (_h ^ (uint32_t)_args[_i]) * 1099511628211ull;
+    return _h;
+}
+
+// return the node with the given code, argument and operands, creating it only if it is new
+// the operands are taken over, equal hashes are told apart by comparing the nodes
+inline int expr_make(simplifier& _simp, unsigned char _code, int _arg, std::vector<int>& _args)
+{
+    uint64_t _h = expr_hash(_code, _arg, _args);
+    typedef std::unordered_multimap<uint64_t, int>::iterator unique_iterator;
+    std::pair<unique_iterator, unique_iterator> _range = _simp.unique.equal_range(_h);
+    for(unique_iterator _it=_range.first; _it!=_range.second; ++_it)
+    {
+        const expr_node& _n = _simp.nodes[_it->second];
+        if(_n.code==_code && _n.arg==_arg && _n.args==_args)
+            return _it->second;
+    }
+
+    expr_node _node;
+    _node.code = _code;
+    _node.arg = _arg;
+    _simp.nodes.push_back(_node);
+    _simp.nodes.back().args.swap(_args);
+    _simp.unique.insert(std::make_pair(_h, (int)_simp.nodes.size()-1));
+    return (int)_simp.nodes.size()-1;
+}
+
+inline int expr_leaf(simplifier& _simp, unsigned char _code, int _arg)
+{
+    std::vector<int> _none;
+    return expr_make(_simp, _code, _arg, _none);
+}
+
+inline int expr_const(simplifier& _simp, bool _val)
+{
+    return expr_leaf(_simp, OP_CONST, _val);
+}
+
+inline bool is_constant(const simplifier& _simp, int _node, int _val)
+{
+    return _simp.nodes[_node].code==OP_CONST && _simp.nodes[_node].arg==_val;
+}
+
+// NOT of a simplified node, folding constants and double negations
+inline int simplify_not(simplifier& _simp, int _x)
+{
+    const expr_node& _n = _simp.nodes[_x];
+    if(_n.code == OP_CONST)
+        return expr_const(_simp, !_n.arg);
+    if(_n.code == OP_NOT)
+        return _n.args[0];
+    std::vector<int> _args(1, _x);
+    return expr_make(_simp, OP_NOT, 0, _args);
+}
+
+// AND, OR or XOR of simplified operands
+inline int simplify_chain(simplifier& _simp, unsigned char _code, const std::vector<int>& _in)
+{
+    std::vector<int> _args;
+    bool _parity = false;       // XOR only, the chain is negated
+
+    // flatten operands of the same operation, they are simplified chains already
+    for(size_t _i=0; _i<_in.size(); ++_i)
+    {
+        const expr_node& _n = _simp.nodes[_in[_i]];
+        if(_n.code == _code)
+            _args.insert(_args.end(), _n.args.begin(), _n.args.end());
+        else
+            _args.push_back(_in[_i]);
+    }
+
+    if(_code == OP_XOR)
+    {
+        // constants and negations move into the parity, then equal operands cancel in pairs
+        std::vector<int> _plain;
+        for(size_t _i=0; _i<_args.size(); ++_i)
+        {
+            const expr_node& _n = _simp.nodes[_args[_i]];
+            if(_n.code == OP_CONST)
+                _parity ^= _n.arg;
+            else if(_n.code == OP_NOT)
+            {
+                _parity = !_parity;
+                _plain.push_back(_n.args[0]);
+            }
+            else
+                _plain.push_back(_args[_i]);
+        }
+        std::sort(_plain.begin(), _plain.end());
+        _args.clear();
+        for(size_t _i=0; _i<_plain.size(); ++_i)
+        {
+            if(_i+1<_plain.size() && _plain[_i]==_plain[_i+1])
+                ++_i;
+            else
+                _args.push_back(_plain[_i]);
+        }
+    }
+    else
+    {
+        // the absorbing constant decides the chain, the neutral one drops out
+        int _absorbing = _code==OP_OR;
+        std::vector<int> _kept;
+        for(size_t _i=0; _i<_args.size(); ++_i)
+        {
+            if(is_constant(_simp, _args[_i], _absorbing))
+                return _args[_i];
+            if(!is_constant(_simp, _args[_i], !_absorbing))
+                _kept.push_back(_args[_i]);
+        }
+        // idempotence
+        std::sort(_kept.begin(), _kept.end());
+        _kept.erase(std::unique(_kept.begin(), _kept.end()), _kept.end());
+        // x and ~x together decide the chain
+        for(size_t _i=0; _i<_kept.size(); ++_i)
+        {
+            const expr_node& _n = _simp.nodes[_kept[_i]];
+            if(_n.code==OP_NOT && std::binary_search(_kept.begin(), _kept.end(), _n.args[0]))
+                return expr_const(_simp, _absorbing);
+        }
+        // absorption, a&(a|b) is a and a|(a&b) is a, looked up by the operands of the dual chain
+        unsigned char _dual = _code==OP_AND ? OP_OR : OP_AND;
+        _args.clear();
+        for(size_t _i=0; _i<_kept.size(); ++_i)
+        {
+            bool _absorbed = false;
+            if(_simp.nodes[_kept[_i]].code == _dual)
+            {
+                const std::vector<int>& _sub = _simp.nodes[_kept[_i]].args;
+                for(size_t _j=0; _j<_sub.size() && !_absorbed; ++_j)
+                    _absorbed = std::binary_search(_kept.begin(), _kept.end(), _sub[_j]);
+            }
+            if(!_absorbed)
+                _args.push_back(_kept[_i]);
+        }
+    }
+
+    int _ret;
+    if(_args.empty())
+        _ret = expr_const(_simp, _code==OP_AND);
+    else if(_args.size() == 1)
+        _ret = _args[0];
+    else
+        _ret = expr_make(_simp, _code, 0, _args);
+    return _parity ? simplify_not(_simp, _ret) : _ret;
+}
+
+// value stack entry of simplify_rpn, a node or the operands gathered so far of a chain whose
+// operation keeps repeating, so a chain is simplified once however long it is
+typedef struct _expr_entry
+{
+    int node;                   // -1 while the chain is open
+    unsigned char code;
+    std::vector<int> args;
+}expr_entry;
+
+// the node of a stack entry, simplifying its chain if it is still open
+inline int close_entry(simplifier& _simp, expr_entry& _entry)
+{
+    if(_entry.node == -1)
+    {
+        _entry.node = simplify_chain(_simp, _entry.code, _entry.args);
+        _entry.args.clear();
+    }
+    return _entry.node;
+}
+
+// simplify a typed post-fix array into the root node _root
+inline status simplify_rpn(simplifier& _simp, const std::vector<token>& _rpn, int& _root)
+{
+    std::vector<expr_entry> _stack;
+    for(size_t _i=0; _i<_rpn.size(); ++_i)
+    {
+        const token& _tok = _rpn[_i];
+        switch(_tok.kind)
+        {
+        case TOK_VAR:
+        case TOK_CONST:
+            _stack.push_back(expr_entry());
+            if(_tok.kind==TOK_VAR && _tok.id<(int)_simp.pinned.size() && _simp.pinned[_tok.id]!=-1)
+                _stack.back().node = expr_const(_simp, _simp.pinned[_tok.id]);
+            else if(_tok.kind == TOK_VAR)
+                _stack.back().node = expr_leaf(_simp, OP_LOAD, _tok.id);
+            else
+                _stack.back().node = expr_const(_simp, _tok.id);
+            break;
+        case TOK_NOT:
+            if(_stack.size() < 1)
+                return make_status(ERR_NOT_OPERANDS, _tok.pos);
+            _stack.back().node = simplify_not(_simp, close_entry(_simp, _stack.back()));
+            break;
+        case TOK_AND:
+        case TOK_OR:
+        case TOK_XOR:
+        {
+            if(_stack.size() < 2)
+                return make_status(ERR_BINARY_OPERANDS, _tok.pos);
+            expr_entry& _left = _stack[_stack.size()-2];
+            expr_entry& _right = _stack.back();
+            // open chains of another operation end here, the left operand opens a chain of this one
+            if(_left.node==-1 && _left.code!=_tok.kind)
+                close_entry(_simp, _left);
+            if(_right.node==-1 && _right.code!=_tok.kind)
+                close_entry(_simp, _right);
+            if(_left.node != -1)
+            {
+                _left.args.assign(1, _left.node);
+                _left.node = -1;
+                _left.code = _tok.kind;
+            }
+            if(_right.node != -1)
+                _left.args.push_back(_right.node);
+            else
+            {
+                // the operands of two open chains are joined into the longer one
+                if(_right.args.size() > _left.args.size())
+                    _left.args.swap(_right.args);
+                _left.args.insert(_left.args.end(), _right.args.begin(), _right.args.end());
+            }
+            _stack.pop_back();
+            break;
+        }
+        }
+    }
+    if(_stack.size() != 1)
+        return make_status(ERR_OPERANDS, _rpn.empty() ? 0 : _rpn.back().pos);
+    _root = close_entry(_simp, _stack[0]);
+    return make_status(ERR_NONE, 0);
+}
+
+// write a simplified node back as typed post-fix tokens, chains as left-deep binary operations
+inline void emit_rpn(const simplifier& _simp, int _node, std::vector<token>& _rpn)
+{
+    const expr_node& _n = _simp.nodes[_node];
+    token _tok = {_n.code, _n.arg, 0, 0};
+    if(_n.code==OP_LOAD || _n.code==OP_CONST)
+    {
+        _rpn.push_back(_tok);
+        return;
+    }
+    for(size_t _i=0; _i<_n.args.size(); ++_i)
+    {
+        emit_rpn(_simp, _n.args[_i], _rpn);
+        if(_i > 0 || _n.code == OP_NOT)
+            _rpn.push_back(_tok);
+    }
+}
+
+// simplify a typed post-fix array into _out, with the variables of _pinned fixed to their values
+// tokens of the result carry no source positions
+inline status simplify(const std::vector<token>& _rpn, const symbol_table& _table, const con_map* _pinned, std::vector<token>& _out)
+{
+    simplifier _simp;
+    _simp.pinned.assign(symbol_count(_table), -1);
+    if(_pinned)
+    {
+        for(con_map::const_iterator _it=_pinned->begin(); _it!=_pinned->end(); ++_it)
+        {
+            int _id = find_symbol(_table, _it->first.data(), _it->first.size());
+            if(_id != -1)
+                _simp.pinned[_id] = _it->second;
+        }
+    }
+    int _root;
+    status _err = simplify_rpn(_simp, _rpn, _root);
+    if(_err.code != ERR_NONE)
+        return _err;
+    _out.clear();
+    emit_rpn(_simp, _root, _out);
+    return _err;
+}
+
+// post-fix text of a typed post-fix array, constants are written as 0 and 1
+inline std::string rpn_to_string(const std::vector<token>& _rpn, const symbol_table& _table)
+{
+    static const char _symbols[] = "\0~&|^()";
+    std::string _ret = "";
+    for(size_t _i=0; _i<_rpn.size(); ++_i)
+    {
+        if(_rpn[_i].kind == TOK_VAR)
+            _ret += "\"" + symbol_name(_table, _rpn[_i].id) + "\"";
+        else if(_rpn[_i].kind == TOK_CONST)
+            _ret += _rpn[_i].id ? '1' : '0';
+        else
+            _ret += _symbols[_rpn[_i].kind];
+    }
+    return _ret;
+}
+
+// gather the values of the variable slots of compiled expressions from a context
+// variables missing from the context are false, like in evaluate
+inline void bind_context(const std::vector<std::string>& _slots, const con_map& _ct, std::vector<unsigned char>& _vals)
+{
+    _vals.resize(_slots.size());
+    for(unsigned int _i=0; _i<_slots.size(); ++_i)
+    {
+        con_map::const_iterator _it = _ct.find(_slots[_i]);
+        _vals[_i] = _it!=_ct.end() && _it->second;
+    }
+}
+
+// run compiled bytecode on values of type T, the value of slot s is the T at _vals + s*_stride bytes
+// every operation is bitwise, so a T holding many contexts evaluates all of them at once
+template <typename T>
+void run_program(const program& _prog, const void* _vals, size_t _stride, T& _out)
+{
+    T _stack[VM_STACK_SIZE];
+    int _top = -1;
+    const instruction* _code = _prog.code.data();
+    const instruction* _end = _code + _prog.code.size();
+
+    for(; _code!=_end; ++_code)
+    {
+        switch(*_code & OP_MASK)
+        {
+        case OP_LOAD:
+            memcpy(&_stack[++_top], (const char*)_vals + (*_code >> OP_BITS)*_stride, sizeof(T));
+            break;
+        case OP_CONST:
+            memset(&_stack[++_top], (*_code >> OP_BITS) ? 0xFF : 0, sizeof(T));
+            break;
+        case OP_NOT:
+            _stack[_top] = ~_stack[_top];
+            break;
+        case OP_AND:
+            --_top;
+            _stack[_top] &= _stack[_top+1];
+            break;
+        case OP_OR:
+            --_top;
+            _stack[_top] |= _stack[_top+1];
+            break;
+        case OP_XOR:
+            --_top;
+            _stack[_top] ^= _stack[_top+1];
+            break;
+        }
+    }
+    _out = _stack[0];
+}
+
+// run compiled bytecode over slot values of 0 or 1
+inline bool execute(const program& _prog, const unsigned char* _vals)
+{
+    unsigned char _ret;
+    run_program(_prog, _vals, 1, _ret);
+    return _ret & 1;
+}
+
+// make room for count contexts, all variables false
+inline void init_batch(const std::vector<std::string>& _slots, size_t _count, batch_context& _batch)
+{
+    _batch.count = _count;
+    _batch.words = (_count+64*LANE_WORDS-1) / (64*LANE_WORDS) * LANE_WORDS;
+    _batch.bits.assign(_slots.size()*_batch.words, 0);
+}
+
+inline void set_batch_value(batch_context& _batch, int _slot, size_t _ctx, bool _val)
+{
+    uint64_t& _word = _batch.bits[_slot*_batch.words + _ctx/64];
+    uint64_t _bit = (uint64_t)1 << (_ctx%64);
+    _word = _val ? _word|_bit : _word&~_bit;
+}
+
+// fill a batch from a list of contexts
+inline void bind_batch(const std::vector<std::string>& _slots, const std::vector<con_map>& _cts, batch_context& _batch)
+{
+    init_batch(_slots, _cts.size(), _batch);
+    for(unsigned int _i=0; _i<_slots.size(); ++_i)
+    {
+        for(size_t _j=0; _j<_cts.size(); ++_j)
+        {
+            con_map::const_iterator _it = _cts[_j].find(_slots[_i]);
+            if(_it!=_cts[_j].end() && _it->second)
+                set_batch_value(_batch, _i, _j, true);
+        }
+    }
+}
+
+// clear the bits of a result column past the last context of a batch
+inline void clear_tail(const batch_context& _batch, uint64_t* _column)
+{
+    if(_batch.count%64 != 0)
+        _column[_batch.count/64] &= ((uint64_t)1 << (_batch.count%64)) - 1;
+    for(size_t _w=(_batch.count+63)/64; _w<_batch.words; ++_w)
+        _column[_w] = 0;
+}
+
+// evaluate the contexts of words [_begin, _end) of a batch, both multiples of LANE_WORDS
+// one pass of the bytecode per lane
+inline void execute_batch_range(const program& _prog, const batch_context& _batch, size_t _begin, size_t _end, uint64_t* _result)
+{
+    const uint64_t* _bits = _batch.bits.data();
+    for(size_t _w=_begin; _w<_end; _w+=LANE_WORDS)
+    {
+        lane _val;
+        run_program(_prog, _bits+_w, _batch.words*sizeof(uint64_t), _val);
+        memcpy(&_result[_w], &_val, sizeof(lane));
+    }
+}
+
+// evaluate every context of a batch, bit j of word w of the result belongs to context 64*w+j
+inline void execute_batch(const program& _prog, const batch_context& _batch, std::vector<uint64_t>& _result)
+{
+    _result.resize(_batch.words);
+    execute_batch_range(_prog, _batch, 0, _batch.words, _result.data());
+    clear_tail(_batch, _result.data());
+}
+
+// words of one chunk of a parallel filter, 256 KB of every column read
+#define FILTER_CHUNK_WORDS 32768
+
+// evaluate every context of a batch on several threads into a selection bitmap
+// threads take chunks of words from a shared counter, so uneven chunks balance out
+inline void filter_batch(const program& _prog, const batch_context& _batch, int _threads, std::vector<uint64_t>& _selected)
+{
+    _selected.resize(_batch.words);
+    size_t _chunks = (_batch.words+FILTER_CHUNK_WORDS-1) / FILTER_CHUNK_WORDS;
+    std::atomic<size_t> _next(0);
+    std::vector<std::thread> _pool;
+    _threads = std::max(1, std::min(_threads, (int)_chunks));
+    for(int _t=0; _t<_threads; ++_t)
+    {
+        _pool.push_back(std::thread([&]() {
+            for(size_t _c=_next++; _c<_chunks; _c=_next++)
+            {
+                size_t _begin = _c*FILTER_CHUNK_WORDS;
+                execute_batch_range(_prog, _batch, _begin, std::min(_begin+FILTER_CHUNK_WORDS, _batch.words), _selected.data());
+            }
+        }));
+    }
+    for(size_t _t=0; _t<_pool.size(); ++_t)
+        _pool[_t].join();
+    clear_tail(_batch, _selected.data());
+}
+
+// read a whole file, return false if it can't be read
+inline bool read_file(const char* _path, std::string& _data)
+{
+    FILE* _file = fopen(_path, "rb");
+    if(_file == NULL)
+        return false;
+    fseek(_file, 0, SEEK_END);
+    long _size = ftell(_file);
+    fseek(_file, 0, SEEK_SET);
+    _data.resize(_size>0 ? _size : 0);
+    bool _ok = _size>=0 && fread(&_data[0], 1, _data.size(), _file)==_data.size();
+    fclose(_file);
+    return _ok;
+}
+
+// load records from CSV text into the bit columns of a batch over the given slots
+// the first line names the variables, every further line is a record of 0/1, true/false or y/n
+// columns that aren't slots are skipped and slots without a column stay false
+inline bool load_columns_csv(const std::string& _data, const std::vector<std::string>& _slots, batch_context& _batch)
+{
+    const char* _p = _data.data();
+    const char* _end = _p + _data.size();
+    const char* _eol = (const char*)memchr(_p, '\n', _end-_p);
+    if(_eol == NULL)
+        _eol = _end;
+
+    // header, column c feeds slot _slot_of[c] or nothing
+    std::map<std::string, int> _names;
+    for(size_t _i=0; _i<_slots.size(); ++_i)
+        _names[_slots[_i]] = (int)_i;
+    std::vector<int> _slot_of;
+    while(_p < _eol)
+    {
+        const char* _comma = (const char*)memchr(_p, ',', _eol-_p);
+        const char* _stop = _comma ? _comma : _eol;
+        std::string _name(_p, _stop);
+        size_t _first = _name.find_first_not_of(" \t\r\"");
+        size_t _last = _name.find_last_not_of(" \t\r\"");
+        _name = _first==std::string::npos ? "" : _name.substr(_first, _last-_first+1);
+        std::map<std::string, int>::iterator _it = _names.find(_name);
+        _slot_of.push_back(_it==_names.end() ? -1 : _it->second);
+        _p = _comma ? _comma+1 : _eol;
+    }
+
+    // count the records to size the columns, blank lines aren't records
+    size_t _count = 0;
+    for(const char* _line=_eol; _line<_end; )
+    {
+        ++_line;
+        const char* _stop = (const char*)memchr(_line, '\n', _end-_line);
+        if(_stop == NULL)
+            _stop = _end;
+        if(_stop>_line && !(_stop-_line==1 && *_line=='\r'))
+            _count++;
+        _line = _stop;
+    }
+    init_batch(_slots, _count, _batch);
+
+    // records, 64 of them are gathered per column before a word is stored
+    std::vector<uint64_t> _pending(_slots.size(), 0);
+    size_t _record = 0;
+    for(const char* _line=_eol; _line<_end; )
+    {
+        ++_line;
+        const char* _stop = (const char*)memchr(_line, '\n', _end-_line);
+        if(_stop == NULL)
+            _stop = _end;
+        if(_stop==_line || (_stop-_line==1 && *_line=='\r'))
+        {
+            _line = _stop;
+            continue;
+        }
+        for(size_t _c=0; _line<_stop; ++_c)
+        {
+            while(_line<_stop && (*_line==' ' || *_line=='\t' || *_line=='"'))
+                ++_line;
+            bool _val = _line<_stop && (*_line=='1' || *_line=='t' || *_line=='T' || *_line=='y' || *_line=='Y');
+            if(_c<_slot_of.size() && _slot_of[_c]!=-1 && _val)
+                _pending[_slot_of[_c]] |= (uint64_t)1 << (_record%64);
+            const char* _comma = (const char*)memchr(_line, ',', _stop-_line);
+            _line = _comma ? _comma+1 : _stop;
+        }
+        if(++_record%64==0 || _record==_count)
+        {
+            for(size_t _s=0; _s<_slots.size(); ++_s)
+            {
+                _batch.bits[_s*_batch.words + (_record-1)/64] = _pending[_s];
+                _pending[_s] = 0;
+            }
+        }
+    }
+    return true;
+}
+
+// binary record file: "SYCB", uint32 column count, uint64 record count, then for every column
+// a uint32 name length, the name and (records+63)/64 words of packed bits
+#define COLUMN_MAGIC "SYCB"
+
+inline bool save_columns_binary(const char* _path, const std::vector<std::string>& _slots, const batch_context& _batch)
+{
+    FILE* _file = fopen(_path, "wb");
+    if(_file == NULL)
+        return false;
+    uint32_t _columns = (uint32_t)_slots.size();
+    uint64_t _count = _batch.count;
+    size_t _words = (_batch.count+63)/64;
+    bool _ok = fwrite(COLUMN_MAGIC, 1, 4, _file)==4 && fwrite(&_columns, sizeof(_columns), 1, _file)==1 && fwrite(&_count, sizeof(_count), 1, _file)==1;
+    for(size_t _s=0; _s<_slots.size() && _ok; ++_s)
+    {
+        uint32_t _len = (uint32_t)_slots[_s].size();
+        _ok = fwrite(&_len, sizeof(_len), 1, _file)==1 && fwrite(_slots[_s].data(), 1, _len, _file)==_len;
+        _ok = _ok && fwrite(&_batch.bits[_s*_batch.words], sizeof(uint64_t), _words, _file)==_words;
+    }
+    return fclose(_file)==0 && _ok;
+}
+
+// load a binary record file into the bit columns of a batch, columns are copied as they are
+// return false for a damaged file, including counts in the header that the file is too short for
+inline bool load_columns_binary(const std::string& _data, const std::vector<std::string>& _slots, batch_context& _batch)
+{
+    uint32_t _columns;
+    uint64_t _count;
+    size_t _pos = 4 + sizeof(_columns) + sizeof(_count);
+    if(_data.size()<_pos || memcmp(_data.data(), COLUMN_MAGIC, 4)!=0)
+        return false;
+    memcpy(&_columns, _data.data()+4, sizeof(_columns));
+    memcpy(&_count, _data.data()+4+sizeof(_columns), sizeof(_count));
+
+    // every column takes at least its name length and its words, so counts that don't fit the file
+    // are rejected before the columns are allocated, the divisions keep the check from overflowing
+    size_t _rest = _data.size() - _pos;
+    if(_count/64 > _rest/sizeof(uint64_t))
+        return false;
+    size_t _words = (_count+63)/64;
+    if(_columns > _rest/(sizeof(uint32_t)+_words*sizeof(uint64_t)))
+        return false;
+    init_batch(_slots, _count, _batch);
+
+    for(uint32_t _c=0; _c<_columns; ++_c)
+    {
+        uint32_t _len;
+        if(_data.size() < _pos+sizeof(_len))
+            return false;
+        memcpy(&_len, _data.data()+_pos, sizeof(_len));
+        _pos += sizeof(_len);
+        if(_data.size() < _pos+_len+_words*sizeof(uint64_t))
+            return false;
+        std::string _name(_data.data()+_pos, _len);
+        _pos += _len;
+        for(size_t _s=0; _s<_slots.size(); ++_s)
+            if(_slots[_s] == _name)
+                memcpy(&_batch.bits[_s*_batch.words], _data.data()+_pos, _words*sizeof(uint64_t));
+        _pos += _words*sizeof(uint64_t);
+    }
+    return true;
+}
+
+// load a record file of either format, binary files start with COLUMN_MAGIC
+inline bool load_columns(const char* _path, const std::vector<std::string>& _slots, batch_context& _batch)
+{
+    std::string _data;
+    if(!read_file(_path, _data))
+        return false;
+    if(_data.compare(0, 4, COLUMN_MAGIC) == 0)
+        return load_columns_binary(_data, _slots, _batch);
+    return load_columns_csv(_data, _slots, _batch);
+}
+
+// return the node for an operation on the given operands, creating it only if it is new
+// operands of commutative operations are ordered so that a&b and b&a are the same node
+// return -1 if a new node is needed and the node ids are used up
+inline int make_node(rule_set& _rules, unsigned char _code, int _a, int _b)
+{
+    if(_code!=OP_LOAD && _code!=OP_CONST && _code!=OP_NOT && _a>_b)
+        std::swap(_a, _b);
+    uint64_t _key = (uint64_t)_code<<58 | (uint64_t)_a<<29 | (uint64_t)_b;
+    std::unordered_map<uint64_t, int>::iterator _it = _rules.unique.find(_key);
+    if(_it != _rules.unique.end())
+        return _it->second;
+    if(_rules.nodes.size() >= DAG_MAX_NODES)
+        return -1;
+
+    dag_node _node = {_code, _a, _b};
+    _rules.nodes.push_back(_node);
+    _rules.unique[_key] = (int)_rules.nodes.size()-1;
+    return (int)_rules.nodes.size()-1;
+}
+
+// add a typed post-fix array with variables interned in _rules.symbols to a rule set
+// the new rule is the last of _rules.roots, a rule with an error adds no root
+inline status add_rule_rpn(rule_set& _rules, const std::vector<token>& _rpn)
+{
+    std::vector<int> _stack;
+    int _a, _b;
+
+    // the slots of a rule set are the ids of its symbol table
+    while((int)_rules.slots.size() < symbol_count(_rules.symbols))
+        _rules.slots.push_back(symbol_name(_rules.symbols, (int)_rules.slots.size()));
+
+    for(size_t _i=0; _i<_rpn.size(); ++_i)
+    {
+        const token& _tok = _rpn[_i];
+        switch(_tok.kind)
+        {
+        // the token is a variable
+        case TOK_VAR:
+            _stack.push_back(make_node(_rules, OP_LOAD, _tok.id, 0));
+            break;
+        // the token is a constant
+        case TOK_CONST:
+            _stack.push_back(make_node(_rules, OP_CONST, _tok.id, 0));
+            break;
+        // the token is a NOT operator
+        case TOK_NOT:
+            if(_stack.size() < 1)
+                return make_status(ERR_NOT_OPERANDS, _tok.pos);
+            _stack.back() = make_node(_rules, OP_NOT, _stack.back(), 0);
+            break;
+        // the token is a binary operator
+        case TOK_AND:
+        case TOK_OR:
+        case TOK_XOR:
+            if(_stack.size() < 2)
+                return make_status(ERR_BINARY_OPERANDS, _tok.pos);
+            _b = _stack.back();
+            _stack.pop_back();
+            _a = _stack.back();
+            _stack.back() = make_node(_rules, _tok.kind, _a, _b);
+            break;
+        }
+        if(!_stack.empty() && _stack.back() == -1)
+            return make_status(ERR_TOO_MANY_NODES, _tok.pos);
+    }
+
+    // should be only one value left in the stack
+    if(_stack.size() != 1)
+        return make_status(ERR_OPERANDS, _rpn.empty() ? 0 : _rpn.back().pos);
+    _rules.roots.push_back(_stack[0]);
+    return make_status(ERR_NONE, 0);
+}
+
+// add the post-fix string of one more rule to a rule set
+inline status add_rule(rule_set& _rules, const std::string& _pf)
+{
+    std::vector<token> _rpn;
+    status _err = tokenize(_pf.data(), _pf.size(), _rules.symbols, _rpn);
+    if(_err.code != ERR_NONE)
+        return _err;
+    return add_rule_rpn(_rules, _rpn);
+}
+
+// parse in-fix rule text and add it to a rule set
+inline status add_rule_text(rule_set& _rules, parser& _parser, const char* _src, size_t _len)
+{
+    status _err = parse_expression(_parser, _rules.symbols, _src, _len);
+    if(_err.code != ERR_NONE)
+        return _err;
+    return add_rule_rpn(_rules, _parser.rpn);
+}
+
+// evaluate every node of a rule set on values of type T, like run_program
+// the value of node i is written to the T at _node_vals + i*sizeof(T) bytes
+template <typename T>
+void run_rules(const rule_set& _rules, const void* _vals, size_t _stride, unsigned char* _node_vals)
+{
+    T _v, _x, _y;
+    for(size_t _i=0; _i<_rules.nodes.size(); ++_i)
+    {
+        const dag_node& _node = _rules.nodes[_i];
+        if(_node.code == OP_LOAD)
+            memcpy(&_v, (const char*)_vals + _node.a*_stride, sizeof(T));
+        else if(_node.code == OP_CONST)
+            memset(&_v, _node.a ? 0xFF : 0, sizeof(T));
+        else
+        {
+            memcpy(&_x, _node_vals + _node.a*sizeof(T), sizeof(T));
+            memcpy(&_y, _node_vals + _node.b*sizeof(T), sizeof(T));
+            switch(_node.code)
+            {
+            case OP_NOT:
+                _v = ~_x;
+                break;
+            case OP_AND:
+                _v = _x & _y;
+                break;
+            case OP_OR:
+                _v = _x | _y;
+                break;
+            case OP_XOR:
+            default:
+                _v = _x ^ _y;
+                break;
+            }
+        }
+        memcpy(_node_vals + _i*sizeof(T), &_v, sizeof(T));
+    }
+}
+
+// evaluate all rules against one context given as slot values of 0 or 1
+inline void execute_rules(const rule_set& _rules, const unsigned char* _vals, std::vector<unsigned char>& _node_vals, std::vector<unsigned char>& _results)
+{
+    _node_vals.resize(_rules.nodes.size());
+    _results.resize(_rules.roots.size());
+    run_rules<unsigned char>(_rules, _vals, 1, _node_vals.data());
+    for(size_t _r=0; _r<_rules.roots.size(); ++_r)
+        _results[_r] = _node_vals[_rules.roots[_r]] & 1;
+}
+
+// evaluate all rules against every context of a batch, one pass over the nodes per lane
+// the result column of rule r starts at word r*_batch.words
+inline void execute_rules_batch(const rule_set& _rules, const batch_context& _batch, std::vector<uint64_t>& _node_vals, std::vector<uint64_t>& _results)
+{
+    _node_vals.resize(_rules.nodes.size()*LANE_WORDS);
+    _results.resize(_rules.roots.size()*_batch.words);
+    const uint64_t* _bits = _batch.bits.data();
+    for(size_t _w=0; _w<_batch.words; _w+=LANE_WORDS)
+    {
+        run_rules<lane>(_rules, _bits+_w, _batch.words*sizeof(uint64_t), (unsigned char*)_node_vals.data());
+        for(size_t _r=0; _r<_rules.roots.size(); ++_r)
+            memcpy(&_results[_r*_batch.words+_w], &_node_vals[_rules.roots[_r]*LANE_WORDS], sizeof(lane));
+    }
+    for(size_t _r=0; _r<_rules.roots.size(); ++_r)
+        clear_tail(_batch, &_results[_r*_batch.words]);
+}
+
+// evaluation of a rule set kept between changes of the context
+typedef struct _incremental_state
+{
+    std::vector<unsigned char> slot_vals;
+    std::vector<unsigned char> node_vals;
+    std::vector<unsigned char> rule_vals;
+    std::vector<int> user_start;         // nodes reading node i are users[user_start[i]..user_start[i+1])
+    std::vector<int> users;
+    std::vector<int> root_start;         // rules rooted at node i are root_rules[root_start[i]..root_start[i+1])
+    std::vector<int> root_rules;
+    std::vector<int> load_of;            // load node of every slot
+    std::vector<char> queued;
+    std::priority_queue<int, std::vector<int>, std::greater<int> > dirty;    // nodes to recompute, lowest first
+}incremental_state;
+
+// bucket the items of pairs (key, item) by key into start/items arrays
+inline void build_index(std::vector<std::pair<int, int> >& _pairs, int _keys, std::vector<int>& _start, std::vector<int>& _items)
+{
+    _start.assign(_keys+1, 0);
+    _items.resize(_pairs.size());
+    for(size_t _i=0; _i<_pairs.size(); ++_i)
+        _start[_pairs[_i].first+1]++;
+    for(int _k=0; _k<_keys; ++_k)
+        _start[_k+1] += _start[_k];
+    std::vector<int> _fill(_start.begin(), _start.end()-1);
+    for(size_t _i=0; _i<_pairs.size(); ++_i)
+        _items[_fill[_pairs[_i].first]++] = _pairs[_i].second;
+}
+
+// evaluate a complete rule set once and build the indexes for incremental updates
+// rules added to the rule set afterwards need a new call
+inline void init_incremental(const rule_set& _rules, const unsigned char* _vals, incremental_state& _state)
+{
+    int _nodes = (int)_rules.nodes.size();
+    std::vector<std::pair<int, int> > _pairs;
+
+    _state.slot_vals.assign(_vals, _vals+_rules.slots.size());
+    execute_rules(_rules, _vals, _state.node_vals, _state.rule_vals);
+    // the byte evaluation only keeps bit 0 meaningful, propagation works on 0 and 1
+    for(int _i=0; _i<_nodes; ++_i)
+        _state.node_vals[_i] &= 1;
+    for(int _i=0; _i<_nodes; ++_i)
+    {
+        const dag_node& _node = _rules.nodes[_i];
+        if(_node.code==OP_LOAD || _node.code==OP_CONST)
+            continue;
+        _pairs.push_back(std::make_pair(_node.a, _i));
+        if(_node.code!=OP_NOT && _node.b!=_node.a)
+            _pairs.push_back(std::make_pair(_node.b, _i));
+    }
+    build_index(_pairs, _nodes, _state.user_start, _state.users);
+
+    _pairs.clear();
+    for(int _r=0; _r<(int)_rules.roots.size(); ++_r)
+        _pairs.push_back(std::make_pair(_rules.roots[_r], _r));
+    build_index(_pairs, _nodes, _state.root_start, _state.root_rules);
+
+    _state.load_of.assign(_rules.slots.size(), -1);
+    for(int _i=0; _i<_nodes; ++_i)
+        if(_rules.nodes[_i].code == OP_LOAD)
+            _state.load_of[_rules.nodes[_i].a] = _i;
+    _state.queued.assign(_nodes, 0);
+    _state.dirty = std::priority_queue<int, std::vector<int>, std::greater<int> >();
+}
+
+// queue a node to be recomputed
+inline void mark_dirty(incremental_state& _state, int _node)
+{
+    if(!_state.queued[_node])
+    {
+        _state.queued[_node] = 1;
+        _state.dirty.push(_node);
+    }
+}
+
+// change the value of a variable slot, the change takes effect in propagate
+inline void set_variable(incremental_state& _state, int _slot, bool _val)
+{
+    if(_state.slot_vals[_slot] == _val)
+        return;
+    _state.slot_vals[_slot] = _val;
+    if(_state.load_of[_slot] != -1)
+        mark_dirty(_state, _state.load_of[_slot]);
+}
+
+// recompute the nodes affected by the changed variables, in node order so that operands are final
+// the rules whose result changed are appended to _changed, once each
+inline void propagate(const rule_set& _rules, incremental_state& _state, std::vector<int>& _changed)
+{
+    unsigned char _v;
+    const std::vector<unsigned char>& _vals = _state.node_vals;
+    while(!_state.dirty.empty())
+    {
+        int _i = _state.dirty.top();
+        _state.dirty.pop();
+        _state.queued[_i] = 0;
+
+        // a of a load is a slot, so operands are only read by the operations
+        const dag_node& _node = _rules.nodes[_i];
+        switch(_node.code)
+        {
+        case OP_LOAD:
+            _v = _state.slot_vals[_node.a];
+            break;
+        case OP_NOT:
+            _v = !_vals[_node.a];
+            break;
+        case OP_AND:
+            _v = _vals[_node.a] & _vals[_node.b];
+            break;
+        case OP_OR:
+            _v = _vals[_node.a] | _vals[_node.b];
+            break;
+        case OP_XOR:
+            _v = _vals[_node.a] ^ _vals[_node.b];
+            break;
+        case OP_CONST:
+        default:
+            _v = _node.a;
+            break;
+        }
+        if(_v == _state.node_vals[_i])
+            continue;
+
+        // the value changed, so do the nodes and rules reading it
+        _state.node_vals[_i] = _v;
+        for(int _k=_state.user_start[_i]; _k<_state.user_start[_i+1]; ++_k)
+            mark_dirty(_state, _state.users[_k]);
+        for(int _k=_state.root_start[_i]; _k<_state.root_start[_i+1]; ++_k)
+        {
+            _state.rule_vals[_state.root_rules[_k]] = _v;
+            _changed.push_back(_state.root_rules[_k]);
+        }
+    }
+}
+
+// lookup of a variable slot for short-circuit evaluation
+typedef bool (*slot_lookup)(int _slot, void* _user);
+
+// measured cost and selectivity of the variable slots of a short-circuit program
+typedef struct _cost_profile
+{
+    std::vector<double> seconds;     // total time spent in the lookups of every slot
+    std::vector<long> calls;
+    std::vector<long> trues;
+}cost_profile;
+
+// expected cost and probability of being true of a subexpression, assuming independent variables
+typedef struct _cost_estimate
+{
+    double cost;
+    double p;
+}cost_estimate;
+
+inline void init_profile(const program& _prog, cost_profile& _profile)
+{
+    _profile.seconds.assign(_prog.slots.size(), 0);
+    _profile.calls.assign(_prog.slots.size(), 0);
+    _profile.trues.assign(_prog.slots.size(), 0);
+}
+
+// mean cost of a lookup over the measured slots of a profile, 1 if there are none
+inline double mean_slot_cost(const cost_profile* _profile)
+{
+    double _sum = 0;
+    int _measured = 0;
+    for(size_t _s=0; _profile && _s<_profile->calls.size(); ++_s)
+    {
+        if(_profile->calls[_s] > 0)
+        {
+            _sum += _profile->seconds[_s] / _profile->calls[_s];
+            _measured++;
+        }
+    }
+    return _measured ? _sum/_measured : 1;
+}
+
+// estimate of a slot, unmeasured slots cost the mean of the measured ones and are true half of the time
+inline cost_estimate slot_estimate(const cost_profile* _profile, int _slot, double _default_cost)
+{
+    cost_estimate _est = {_default_cost, 0.5};
+    if(_profile && _slot<(int)_profile->calls.size() && _profile->calls[_slot]>0)
+    {
+        _est.cost = _profile->seconds[_slot] / _profile->calls[_slot];
+        _est.p = (double)_profile->trues[_slot] / _profile->calls[_slot];
+    }
+    return _est;
+}
+
+// deepest nesting of subexpressions compile_short_circuit takes, it recurses once per level
+#define SHORT_CIRCUIT_MAX_NESTING 4096
+
+// state of compiling one expression to short-circuit bytecode
+typedef struct _short_circuit_compiler
+{
+    const rule_set* rules;
+    const cost_profile* profile;
+    double default_cost;                     // cost of the slots the profile hasn't measured
+    std::vector<cost_estimate> estimates;    // estimate of every node, computed once on demand
+    std::vector<char> estimated;
+}short_circuit_compiler;
+
+// collect the operands of a chain of the same AND or OR operation, in written order
+// the chain is walked with an explicit stack, it may be as long as the rule
+inline void flatten_chain(const rule_set& _rules, int _node, unsigned char _code, std::vector<int>& _operands)
+{
+    std::vector<int> _pending(1, _node);
+    while(!_pending.empty())
+    {
+        const dag_node& _n = _rules.nodes[_pending.back()];
+        if(_n.code != _code)
+        {
+            _operands.push_back(_pending.back());
+            _pending.pop_back();
+            continue;
+        }
+        _pending.back() = _n.b;
+        _pending.push_back(_n.a);
+    }
+}
+
+// deepest nesting of the subexpressions of a rule set, the calls of estimate_node and
+// emit_short_circuit for a node go this deep; a chain counts once however long it is
+// the nodes are in operand order, so one pass gives the nesting of every node
+inline int short_circuit_nesting(const rule_set& _rules, int _root)
+{
+    std::vector<int> _nesting(_root+1, 0);
+    for(int _i=0; _i<=_root; ++_i)
+    {
+        const dag_node& _n = _rules.nodes[_i];
+        if(_n.code==OP_LOAD || _n.code==OP_CONST)
+            continue;
+        bool _chain = _n.code==OP_AND || _n.code==OP_OR;
+        int _a = _nesting[_n.a] + !(_chain && _rules.nodes[_n.a].code==_n.code);
+        int _b = _n.code==OP_NOT ? 0 : _nesting[_n.b] + !(_chain && _rules.nodes[_n.b].code==_n.code);
+        _nesting[_i] = std::max(std::max(_a, _b), 1);
+    }
+    return _nesting[_root];
+}
+
+inline cost_estimate estimate_node(short_circuit_compiler& _comp, int _node);
+
+// collect the operands of the AND or OR chain at a node in the order they will run
+// that is written order, or by rank when there is a profile: cost over the chance to decide
+// the chain, which is the optimal order for independent operands
+// return the estimate of the whole chain, only meaningful with a profile
+inline cost_estimate order_chain(short_circuit_compiler& _comp, int _node, std::vector<int>& _operands)
+{
+    unsigned char _code = _comp.rules->nodes[_node].code;
+    bool _and = _code == OP_AND;
+    cost_estimate _est = {0, 0.5};
+    _operands.clear();
+    flatten_chain(*_comp.rules, _node, _code, _operands);
+    if(!_comp.profile)
+        return _est;
+
+    std::vector<std::pair<double, int> > _ranked;
+    for(size_t _i=0; _i<_operands.size(); ++_i)
+    {
+        cost_estimate _x = estimate_node(_comp, _operands[_i]);
+        double _decide = _and ? 1-_x.p : _x.p;
+        _ranked.push_back(std::make_pair(_decide>0 ? _x.cost/_decide : 1e300, _operands[_i]));
+    }
+    std::stable_sort(_ranked.begin(), _ranked.end());
+
+    // the chain gets to an operand only if none before it decided the result
+    double _reach = 1;
+    for(size_t _i=0; _i<_ranked.size(); ++_i)
+    {
+        _operands[_i] = _ranked[_i].second;
+        cost_estimate _x = estimate_node(_comp, _operands[_i]);
+        _est.cost += _reach*_x.cost;
+        _reach *= _and ? _x.p : 1-_x.p;
+    }
+    _est.p = _and ? _reach : 1-_reach;
+    return _est;
+}
+
+// expected cost and probability of being true of a node
+inline cost_estimate estimate_node(short_circuit_compiler& _comp, int _node)
+{
+    if(_comp.estimated[_node])
+        return _comp.estimates[_node];
+    const dag_node& _n = _comp.rules->nodes[_node];
+    cost_estimate _est, _x, _y;
+    std::vector<int> _operands;
+    switch(_n.code)
+    {
+    case OP_LOAD:
+        _est = slot_estimate(_comp.profile, _n.a, _comp.default_cost);
+        break;
+    case OP_CONST:
+        _est.cost = 0;
+        _est.p = _n.a;
+        break;
+    case OP_NOT:
+        _est = estimate_node(_comp, _n.a);
+        _est.p = 1-_est.p;
+        break;
+    case OP_XOR:
+        _x = estimate_node(_comp, _n.a);
+        _y = estimate_node(_comp, _n.b);
+        _est.cost = _x.cost + _y.cost;
+        _est.p = _x.p*(1-_y.p) + _y.p*(1-_x.p);
+        break;
+    default:
+        _est = order_chain(_comp, _node, _operands);
+        break;
+    }
+    _comp.estimated[_node] = 1;
+    _comp.estimates[_node] = _est;
+    return _est;
+}
+
+// emit short-circuit bytecode for a node, _depth is the stack depth its value lands at
+// return false if the value stack would overflow
+inline bool emit_short_circuit(short_circuit_compiler& _comp, int _node, int _depth, program& _prog)
+{
+    const dag_node& _n = _comp.rules->nodes[_node];
+    if(_depth > VM_STACK_SIZE)
+        return false;
+
+    switch(_n.code)
+    {
+    case OP_LOAD:
+    case OP_CONST:
+        _prog.code.push_back((instruction)_n.a<<OP_BITS | _n.code);
+        return true;
+    case OP_NOT:
+        if(!emit_short_circuit(_comp, _n.a, _depth, _prog))
+            return false;
+        _prog.code.push_back(OP_NOT);
+        return true;
+    case OP_XOR:
+        if(!emit_short_circuit(_comp, _n.a, _depth, _prog) || !emit_short_circuit(_comp, _n.b, _depth+1, _prog))
+            return false;
+        _prog.code.push_back(OP_XOR);
+        return true;
+    }
+
+    // AND or OR chain, every operand after the first is skipped once the result is decided
+    std::vector<int> _operands;
+    std::vector<size_t> _jumps;
+    order_chain(_comp, _node, _operands);
+    for(size_t _i=0; _i<_operands.size(); ++_i)
+    {
+        if(_i > 0)
+        {
+            _jumps.push_back(_prog.code.size());
+            _prog.code.push_back(_n.code==OP_AND ? OP_JUMP_FALSE : OP_JUMP_TRUE);
+        }
+        if(!emit_short_circuit(_comp, _operands[_i], _depth, _prog))
+            return false;
+    }
+    for(size_t _i=0; _i<_jumps.size(); ++_i)
+        _prog.code[_jumps[_i]] |= (instruction)_prog.code.size()<<OP_BITS;
+    return true;
+}
+
+// compile the post-fix string into short-circuit bytecode, optionally ordered by a profile
+// the slots keep the numbering of compile, so a profile measured on either applies to both
+// the DAG keeps no source positions, so a nesting error is reported at the start of the text,
+// that is more than SHORT_CIRCUIT_MAX_NESTING nested subexpressions or an overflowing value stack
+inline status compile_short_circuit(const std::string& _pf, const cost_profile* _profile, program& _prog)
+{
+    rule_set _rules;
+    short_circuit_compiler _comp;
+    status _err = add_rule(_rules, _pf);
+    if(_err.code != ERR_NONE)
+        return _err;
+    _comp.rules = &_rules;
+    _comp.profile = _profile;
+    _comp.default_cost = mean_slot_cost(_profile);
+    if(short_circuit_nesting(_rules, _rules.roots[0]) > SHORT_CIRCUIT_MAX_NESTING)
+        return make_status(ERR_TOO_DEEP, 0);
+    _comp.estimates.resize(_rules.nodes.size());
+    _comp.estimated.assign(_rules.nodes.size(), 0);
+    _prog.code.clear();
+    _prog.slots = _rules.slots;
+    if(!emit_short_circuit(_comp, _rules.roots[0], 1, _prog))
+        return make_status(ERR_TOO_DEEP, 0);
+    return _err;
+}
+
+// run short-circuit bytecode, looking up every variable on first use only
+// _known is scratch space, lookups are timed and counted into the profile if one is given
+inline bool execute_short_circuit(const program& _prog, slot_lookup _lookup, void* _user, std::vector<signed char>& _known, cost_profile* _profile)
+{
+    unsigned char _stack[VM_STACK_SIZE];
+    int _top = -1;
+    size_t _pc = 0;
+    size_t _end = _prog.code.size();
+    _known.assign(_prog.slots.size(), -1);
+
+    while(_pc < _end)
+    {
+        instruction _ins = _prog.code[_pc++];
+        unsigned int _arg = _ins >> OP_BITS;
+        switch(_ins & OP_MASK)
+        {
+        case OP_LOAD:
+            if(_known[_arg] == -1)
+            {
+                if(_profile)
+                {
+                    std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+                    _known[_arg] = _lookup(_arg, _user);
+                    _profile->seconds[_arg] += std::chrono::duration<double>(std::chrono::steady_clock::now()-_start).count();
+                    _profile->calls[_arg]++;
+                    _profile->trues[_arg] += _known[_arg];
+                }
+                else
+                    _known[_arg] = _lookup(_arg, _user);
+            }
+            _stack[++_top] = _known[_arg];
+            break;
+        case OP_CONST:
+            _stack[++_top] = _arg;
+            break;
+        case OP_NOT:
+            _stack[_top] ^= 1;
+            break;
+        case OP_XOR:
+            --_top;
+            _stack[_top] ^= _stack[_top+1];
+            break;
+        case OP_JUMP_FALSE:
+            if(!_stack[_top])
+                _pc = _arg;
+            else
+                --_top;
+            break;
+        case OP_JUMP_TRUE:
+            if(_stack[_top])
+                _pc = _arg;
+            else
+                --_top;
+            break;
+        }
+    }
+    return _stack[0];
+}
+
+// lookup from a context that counts the lookups made
+typedef struct _counted_context
+{
+    const con_map* context;
+    const std::vector<std::string>* slots;
+    int lookups;
+}counted_context;
+
+inline bool counted_lookup(int _slot, void* _user)
+{
+    counted_context* _ct = (counted_context*)_user;
+    _ct->lookups++;
+    con_map::const_iterator _it = _ct->context->find((*_ct->slots)[_slot]);
+    return _it!=_ct->context->end() && _it->second;
+}
+
+// expression over at most TRUTH_TABLE_MAX_VARS variables, bit i is the value for assignment i,
+// where bit k of i is the value of slot k
+#define TRUTH_TABLE_MAX_VARS 16
+typedef struct _truth_table
+{
+    int vars;
+    std::vector<uint64_t> bits;
+}truth_table;
+
+// fill the truth table of a compiled expression with one batch over all assignments
+// return false if it has too many variables
+inline bool build_truth_table(const program& _prog, truth_table& _table)
+{
+    // columns of the first six variables repeat within a word, the others are whole words
+    static const uint64_t _patterns[6] = {
+        0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+        0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull
+    };
+    int _vars = (int)_prog.slots.size();
+    if(_vars > TRUTH_TABLE_MAX_VARS)
+        return false;
+
+    batch_context _batch;
+    init_batch(_prog.slots, (size_t)1<<_vars, _batch);
+    for(int _k=0; _k<_vars; ++_k)
+        for(size_t _w=0; _w<_batch.words; ++_w)
+            _batch.bits[_k*_batch.words+_w] = _k<6 ? _patterns[_k] : ((_w>>(_k-6))&1 ? ~0ull : 0);
+    execute_batch(_prog, _batch, _table.bits);
+    _table.bits.resize((((size_t)1<<_vars)+63)/64);
+    _table.vars = _vars;
+    return true;
+}
+
+// value of a truth table for slot values of 0 or 1
+inline bool truth_lookup(const truth_table& _table, const unsigned char* _vals)
+{
+    unsigned int _i = 0;
+    for(int _k=0; _k<_table.vars; ++_k)
+        _i |= (unsigned int)_vals[_k] << _k;
+    return (_table.bits[_i>>6] >> (_i&63)) & 1;
+}
+
+// node of a reduced ordered BDD, variables are tested in slot order
+typedef struct _bdd_node
+{
+    int var;        // slot tested, INT_MAX for the terminals
+    int low;        // node when the slot is false
+    int high;       // node when the slot is true
+}bdd_node;
+
+#define BDD_FALSE 0
+#define BDD_TRUE 1
+
+// key of the unique table (var, low, high) and of the apply cache (op, f, g)
+typedef struct _bdd_key
+{
+    int a;
+    int b;
+    int c;
+    bool operator==(const _bdd_key& _o) const
+    {
+        return a==_o.a && b==_o.b && c==_o.c;
+    }
+}bdd_key;
+
+struct bdd_key_hash
+{
+    size_t operator()(const bdd_key& _k) const
+    {
+        uint64_t _h = (uint64_t)(unsigned int)_k.a*0x9E3779B97F4A7C15ull;
+        _h ^= ((uint64_t)(unsigned int)_k.b<<32 | (unsigned int)_k.c) + 0x632BE59BD9B4E019ull + (_h<<6) + (_h>>2);
+        return (size_t)(_h ^ (_h>>29));
+    }
+};
+
+// shared BDD of a set of expressions, nodes 0 and 1 are the terminals
+// building gives up once max_nodes is reached, so a blow-up can fall back to bytecode,
+// and an overflowed BDD is only good for init_bdd again
+typedef struct _bdd
+{
+    std::vector<bdd_node> nodes;
+    std::unordered_map<bdd_key, int, bdd_key_hash> unique;
+    std::unordered_map<bdd_key, int, bdd_key_hash> computed;
+    size_t max_nodes;
+    bool overflow;
+}bdd;
+
+inline void init_bdd(bdd& _bdd, size_t _max_nodes)
+{
+    bdd_node _terminal = {INT_MAX, -1, -1};
+    _bdd.nodes.assign(2, _terminal);
+    _bdd.unique.clear();
+    _bdd.computed.clear();
+    _bdd.max_nodes = _max_nodes;
+    _bdd.overflow = false;
+}
+
+// the node testing var, reduced: no test with equal branches and no duplicate nodes
+inline int bdd_make(bdd& _bdd, int _var, int _low, int _high)
+{
+    if(_low == _high)
+        return _low;
+    bdd_key _key = {_var, _low, _high};
+    std::unordered_map<bdd_key, int, bdd_key_hash>::iterator _it = _bdd.unique.find(_key);
+    if(_it != _bdd.unique.end())
+        return _it->second;
+    if(_bdd.nodes.size() >= _bdd.max_nodes)
+    {
+        _bdd.overflow = true;
+        return BDD_FALSE;
+    }
+    bdd_node _node = {_var, _low, _high};
+    _bdd.nodes.push_back(_node);
+    _bdd.unique[_key] = (int)_bdd.nodes.size()-1;
+    return (int)_bdd.nodes.size()-1;
+}
+
+// combine two BDDs with AND, OR or XOR, memoized on (op, f, g)
+inline int bdd_apply(bdd& _bdd, unsigned char _code, int _f, int _g)
+{
+    // terminal cases
+    if(_f > _g)
+        std::swap(_f, _g);
+    switch(_code)
+    {
+    case OP_AND:
+        if(_f==BDD_FALSE || _f==_g)
+            return _f;
+        if(_f == BDD_TRUE)
+            return _g;
+        break;
+    case OP_OR:
+        if(_f==BDD_TRUE || _f==_g)
+            return _f;
+        if(_f == BDD_FALSE)
+            return _g;
+        if(_g == BDD_TRUE)
+            return BDD_TRUE;
+        break;
+    case OP_XOR:
+        if(_f == _g)
+            return BDD_FALSE;
+        if(_f == BDD_FALSE)
+            return _g;
+        break;
+    }
+    if(_bdd.overflow)
+        return BDD_FALSE;
+
+    bdd_key _key = {_code, _f, _g};
+    std::unordered_map<bdd_key, int, bdd_key_hash>::iterator _it = _bdd.computed.find(_key);
+    if(_it != _bdd.computed.end())
+        return _it->second;
+
+    // split on the first variable tested by either side
+    int _var = std::min(_bdd.nodes[_f].var, _bdd.nodes[_g].var);
+    int _f0 = _bdd.nodes[_f].var==_var ? _bdd.nodes[_f].low : _f;
+    int _f1 = _bdd.nodes[_f].var==_var ? _bdd.nodes[_f].high : _f;
+    int _g0 = _bdd.nodes[_g].var==_var ? _bdd.nodes[_g].low : _g;
+    int _g1 = _bdd.nodes[_g].var==_var ? _bdd.nodes[_g].high : _g;
+    int _low = bdd_apply(_bdd, _code, _f0, _g0);
+    int _high = bdd_apply(_bdd, _code, _f1, _g1);
+    int _ret = bdd_make(_bdd, _var, _low, _high);
+    _bdd.computed[_key] = _ret;
+    return _ret;
+}
+
+// build the BDD of every rule of a rule set, bottom-up over the DAG
+// return false if the BDD grew past its node limit
+inline bool build_bdd(const rule_set& _rules, bdd& _bdd, std::vector<int>& _roots)
+{
+    std::vector<int> _of(_rules.nodes.size());
+    for(size_t _i=0; _i<_rules.nodes.size() && !_bdd.overflow; ++_i)
+    {
+        const dag_node& _node = _rules.nodes[_i];
+        switch(_node.code)
+        {
+        case OP_LOAD:
+            _of[_i] = bdd_make(_bdd, _node.a, BDD_FALSE, BDD_TRUE);
+            break;
+        case OP_CONST:
+            _of[_i] = _node.a ? BDD_TRUE : BDD_FALSE;
+            break;
+        case OP_NOT:
+            _of[_i] = bdd_apply(_bdd, OP_XOR, _of[_node.a], BDD_TRUE);
+            break;
+        default:
+            _of[_i] = bdd_apply(_bdd, _node.code, _of[_node.a], _of[_node.b]);
+            break;
+        }
+    }
+    _roots.resize(_rules.roots.size());
+    for(size_t _r=0; _r<_rules.roots.size() && !_bdd.overflow; ++_r)
+        _roots[_r] = _of[_rules.roots[_r]];
+    return !_bdd.overflow;
+}
+
+// evaluate a BDD for slot values of 0 or 1, one step per tested variable
+inline bool bdd_evaluate(const bdd& _bdd, int _root, const unsigned char* _vals)
+{
+    while(_root > BDD_TRUE)
+        _root = _vals[_bdd.nodes[_root].var] ? _bdd.nodes[_root].high : _bdd.nodes[_root].low;
+    return _root == BDD_TRUE;
+}
+
+// fraction of all assignments that satisfy a BDD, memoized per node in _memo
+inline double bdd_fraction(const bdd& _bdd, int _root, std::vector<double>& _memo)
+{
+    if(_root <= BDD_TRUE)
+        return _root;
+    if(_memo.size() < _bdd.nodes.size())
+        _memo.resize(_bdd.nodes.size(), -1);
+    if(_memo[_root] < 0)
+        _memo[_root] = 0.5*bdd_fraction(_bdd, _bdd.nodes[_root].low, _memo) + 0.5*bdd_fraction(_bdd, _bdd.nodes[_root].high, _memo);
+    return _memo[_root];
+}
+
+#if __cplusplus >= 201703L
+
+// program parsed at compile time from a string literal of N characters
+// instruction i computes the subexpression that starts at instruction begin[i]
+template <size_t N>
+struct static_program
+{
+    instruction code[N] = {};
+    size_t begin[N] = {};
+    size_t size = 0;
+    int slots = 0;
+    size_t name_pos[N] = {};        // name of slot i is the text at source+name_pos[i]
+    size_t name_len[N] = {};
+    const char* source = nullptr;
+    const char* error = nullptr;    // message of the first parse error
+};
+
+// append one instruction, checking its stack effect like compile_rpn
+template <size_t N>
+constexpr void static_emit(static_program<N>& _prog, size_t* _starts, int& _depth, int _kind, int _arg)
+{
+    size_t _i = _prog.size;
+    if(_prog.error || _i == N)
+        return;
+    if(_kind == TOK_VAR || _kind == TOK_CONST)
+    {
+        if(_depth == VM_STACK_SIZE)
+        {
+            _prog.error = "expression too deeply nested";
+            return;
+        }
+        _prog.code[_i] = (instruction)_arg<<OP_BITS | _kind;
+        _prog.begin[_i] = _i;
+        _starts[_depth++] = _i;
+    }
+    else if(_kind == TOK_NOT)
+    {
+        if(_depth < 1)
+        {
+            _prog.error = "variables for NOT operator mismatched";
+            return;
+        }
+        _prog.code[_i] = OP_NOT;
+        _prog.begin[_i] = _starts[_depth-1];
+    }
+    else
+    {
+        if(_depth < 2)
+        {
+            _prog.error = "variables for binary operator mismatched";
+            return;
+        }
+        _prog.code[_i] = _kind;
+        _prog.begin[_i] = _starts[_depth-2];
+        --_depth;
+    }
+    _prog.size++;
+}
+
+// shunting yard and compile in one pass over a string literal, meant for constexpr variables
+// variables get slots in order of first appearance, like compile
+template <size_t N>
+constexpr static_program<N> parse_static(const char (&_src)[N])
+{
+    static_program<N> _prog;
+    int _ops[N] = {};
+    size_t _starts[VM_STACK_SIZE] = {};
+    int _top = 0;
+    int _depth = 0;
+    _prog.source = _src;
+
+    for(size_t _i=0; _i+1<N && !_prog.error; ++_i)
+    {
+        int _kind = -1;
+        switch(_src[_i])
+        {
+        case '"':
+        {
+            size_t _pos = _i+1;
+            for(++_i; _i+1<N && _src[_i]!='"'; ++_i)
+                ;
+            if(_i+1 >= N)
+            {
+                _prog.error = "variable not closed by \" symbol";
+                break;
+            }
+            // find the slot of the name or give it the next one
+            size_t _len = _i-_pos;
+            int _slot = 0;
+            for(; _slot<_prog.slots; ++_slot)
+            {
+                bool _same = _prog.name_len[_slot] == _len;
+                for(size_t _k=0; _same && _k<_len; ++_k)
+                    _same = _src[_prog.name_pos[_slot]+_k] == _src[_pos+_k];
+                if(_same)
+                    break;
+            }
+            if(_slot == _prog.slots)
+            {
+                _prog.name_pos[_slot] = _pos;
+                _prog.name_len[_slot] = _len;
+                _prog.slots++;
+            }
+            static_emit(_prog, _starts, _depth, TOK_VAR, _slot);
+            break;
+        }
+        case '~':
+            _kind = TOK_NOT;
+            break;
+        case '&':
+            _kind = TOK_AND;
+            break;
+        case '|':
+            _kind = TOK_OR;
+            break;
+        case '^':
+            _kind = TOK_XOR;
+            break;
+        case '(':
+            _ops[_top++] = TOK_LEFT;
+            break;
+        case ')':
+            while(_top>0 && _ops[_top-1]!=TOK_LEFT)
+                static_emit(_prog, _starts, _depth, _ops[--_top], 0);
+            if(_top == 0)
+                _prog.error = "mismatched right parenthesis";
+            else
+                --_top;
+            break;
+        }
+        if(_kind != -1)
+        {
+            while(_top>0 && pops_before(_ops[_top-1], _kind))
+                static_emit(_prog, _starts, _depth, _ops[--_top], 0);
+            _ops[_top++] = _kind;
+        }
+    }
+    while(_top>0 && !_prog.error)
+    {
+        if(_ops[_top-1] == TOK_LEFT)
+            _prog.error = "mismatched left parenthesis";
+        else
+            static_emit(_prog, _starts, _depth, _ops[--_top], 0);
+    }
+    if(!_prog.error && _depth != 1)
+        _prog.error = "operators and variables in post-fix string mismatched";
+    return _prog;
+}
+
+// a NOT applies to the NOT after it: ~~A loads A and negates twice, A&~~B negates B twice before the AND
+static_assert(!parse_static("~~\"A\"").error && parse_static("~~\"A\"").size == 3
+              && parse_static("~~\"A\"").code[2] == OP_NOT, "~~ is parsed as a double negation");
+static_assert(!parse_static("\"A\"&~~\"B\"").error && parse_static("\"A\"&~~\"B\"").code[3] == OP_NOT
+              && parse_static("\"A\"&~~\"B\"").code[4] == TOK_AND, "~~ binds tighter than &");
+
+// value of the subexpression ending at instruction I of a program known at compile time
+// the recursion unrolls into straight-line bitwise operations on T
+template <const auto& P, size_t I, typename T>
+inline T static_eval(const T* _vals)
+{
+    constexpr instruction _ins = P.code[I];
+    constexpr unsigned int _code = _ins & OP_MASK;
+    if constexpr(_code == OP_LOAD)
+        return _vals[_ins >> OP_BITS];
+    else if constexpr(_code == OP_CONST)
+        return (_ins >> OP_BITS) ? (T)~T() : T();
+    else if constexpr(_code == OP_NOT)
+        return (T)~static_eval<P, I-1, T>(_vals);
+    else
+    {
+        // the right operand ends just before I, the left one just before the right one begins
+        constexpr size_t _right = I-1;
+        constexpr size_t _left = P.begin[_right]-1;
+        T _a = static_eval<P, _left, T>(_vals);
+        T _b = static_eval<P, _right, T>(_vals);
+        if constexpr(_code == OP_AND)
+            return _a & _b;
+        else if constexpr(_code == OP_OR)
+            return _a | _b;
+        else
+            return _a ^ _b;
+    }
+}
+
+// evaluate a program from parse_static on slot values of type T, 0 or 1 bytes for one context
+// or words of bit columns for 64 contexts at once
+template <const auto& P, typename T>
+inline T evaluate_static(const T* _vals)
+{
+    static_assert(P.error == nullptr, "rule doesn't parse");
+    return static_eval<P, P.size-1, T>(_vals);
+}
+
+// gather the slot values of a program from parse_static from a context
+template <size_t N>
+void bind_static(const static_program<N>& _prog, const con_map& _ct, unsigned char* _vals)
+{
+    for(int _i=0; _i<_prog.slots; ++_i)
+    {
+        con_map::const_iterator _it = _ct.find(std::string(_prog.source+_prog.name_pos[_i], _prog.name_len[_i]));
+        _vals[_i] = _it!=_ct.end() && _it->second;
+    }
+}
+#endif
+
+#endif
@@ -0,0 +1,568 @@
+//
+//  shunting_yard_benchmark.cpp
+//  Algorithm
+//
+//  Benchmark of the expression engines of shunting_yard.h over generated expressions and contexts,
+//  to measure the gain of every evaluation strategy and to catch performance regressions.
+//
+//  expressions are generated from a seed over variables "v0".."v<vars-1>": every node down to the
+//  given depth is an operator drawn from the operator mix, with one chance in four of stopping early
+//  at a variable; NOT is written as a bare prefix ~, as a double ~~ or as ~( ) around its operand,
+//  every operand is a variable, a NOT or parenthesized, so the bare prefixes need no parentheses
+//  contexts are random assignments of all the variables, or a random walk changing -flips variables
+//  from one context to the next, which is the case incremental evaluation is made for
+//
+//  parsers are measured in MB/s of expression text, engines in evaluations per second, where one
+//  evaluation is one expression against one context; every table also reports the allocations
+//  made per expression or per evaluation, counted by the global operator new of this program
+//  a '*' after the number of true results marks an engine that disagrees with evaluate
+//  rules parsed at compile time (evaluate_static) can't be generated at run time and aren't measured
+//
+//  command line: [-depth d] [-vars v] [-mix not,and,or,xor] [-rules r] [-contexts c] [-flips f]
+//                [-seed s] [-time seconds] [-threads t]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <random>
+#include <atomic>
+#include <new>
+#include <time.h>
+#include "shunting_yard.h"
+
+typedef struct _engine
+{
+    const char* name;
+    // evaluate every expression against every context once, return the number of evaluations
+    // and add the number of true results to trues
+    long long (*round)(long long& trues);
+    bool (*ready)();    // whether the engine can run on the generated input, NULL if always
+}ENGINE;
+
+int depth = 6;
+int vars = 16;
+int mix[4] = {1, 2, 2, 1};      // weights of NOT, AND, OR and XOR
+int ruleCount = 100;
+int contextCount = 1024;
+int flips = 0;
+unsigned long long seed = 1;
+double minSeconds = 0.5;
+int threads = 4;
+
+std::atomic<long long> allocations(0);
+
+std::vector<std::string> expressions;
+std::vector<std::string> postFixes;
+std::vector<con_map> contexts;
+std::vector<unsigned char> contextVals;     // value of variable v of context c at c*vars+v
+opt_map operators;
+
+// prepared input of every engine
+std::vector<program> programs;
+std::vector<program> simplifiedPrograms;
+std::vector<program> lazyPrograms;
+std::vector<std::vector<unsigned char> > slotVals;     // per expression, the slot values of context c at c*slots
+std::vector<batch_context> batches;
+std::vector<truth_table> truthTables;
+rule_set rules;
+std::vector<unsigned char> ruleVals;        // per context, the values of the slots of the rule set
+batch_context ruleBatch;
+incremental_state incremental;
+bdd decisionDiagram;
+std::vector<int> bddRoots;
+bool bddReady;
+
+// scratch of the engines and parsers, kept between rounds so that only the engines allocate
+std::vector<uint64_t> resultBits;
+std::vector<uint64_t> nodeBits;
+std::vector<unsigned char> nodeVals;
+std::vector<unsigned char> ruleResults;
+std::vector<signed char> known;
+std::vector<int> changed;
+parser typedParser;
+symbol_table typedSymbols;
+std::string postFix;
+program compiled;
+
+// kept out of line, so that the compiler doesn't pair an inlined free with a new expression
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if(p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// ---- generators ----
+
+std::string generateExpression(std::mt19937_64& rng, int level)
+{
+    std::uniform_int_distribution<int> variable(0, vars-1);
+    if(level == 0 || rng()%4 == 0)
+        return "\"v" + std::to_string(variable(rng)) + "\"";
+
+    int total = mix[0]+mix[1]+mix[2]+mix[3];
+    int pick = (int)(rng()%total);
+    int op = 0;
+    while(pick >= mix[op])
+        pick -= mix[op++];
+    if(op == 0)
+    {
+        switch(rng()%3)
+        {
+        case 0:
+            return "~" + generateExpression(rng, level-1);
+        case 1:
+            return "~~" + generateExpression(rng, level-1);
+        default:
+            return "~(" + generateExpression(rng, level-1) + ")";
+        }
+    }
+    std::string left = generateExpression(rng, level-1);
+    return "(" + left + "&|^"[op-1] + generateExpression(rng, level-1) + ")";
+}
+
+void generateContexts(std::mt19937_64& rng)
+{
+    std::uniform_int_distribution<int> variable(0, vars-1);
+    contextVals.resize((size_t)contextCount*vars);
+    for(int c=0; c<contextCount; ++c)
+    {
+        unsigned char* vals = &contextVals[(size_t)c*vars];
+        if(c == 0 || flips <= 0)
+        {
+            for(int v=0; v<vars; ++v)
+                vals[v] = rng()&1;
+        }
+        else
+        {
+            memcpy(vals, vals-vars, vars);
+            for(int f=0; f<flips; ++f)
+                vals[variable(rng)] ^= 1;
+        }
+    }
+    contexts.assign(contextCount, con_map());
+    for(int c=0; c<contextCount; ++c)
+        for(int v=0; v<vars; ++v)
+            contexts[c]["v"+std::to_string(v)] = contextVals[(size_t)c*vars+v];
+}
+
+// variable number of a slot name "v<n>"
+int variableOf(const std::string& name)
+{
+    return atoi(name.c_str()+1);
+}
+
+// ---- preparation, not measured ----
+
+bool prepare()
+{
+    status err;
+    operators['('] = 0;
+    operators[')'] = 0;
+    operators['~'] = 3;
+    operators['&'] = 2;
+    operators['|'] = 2;
+    operators['^'] = 1;
+
+    int n = (int)expressions.size();
+    postFixes.resize(n);
+    programs.resize(n);
+    simplifiedPrograms.resize(n);
+    lazyPrograms.resize(n);
+    slotVals.resize(n);
+    batches.resize(n);
+    truthTables.resize(n);
+    parser ps;
+    for(int e=0; e<n; ++e)
+    {
+        err = shuntingYard(expressions[e], operators, postFixes[e]);
+        if(err.code == ERR_NONE)
+            err = compile(postFixes[e], programs[e]);
+        if(err.code == ERR_NONE)
+            err = compile_short_circuit(postFixes[e], NULL, lazyPrograms[e]);
+
+        // the simplified program keeps the slots of the original one, so both read the same values
+        symbol_table symbols;
+        std::vector<token> simplified;
+        if(err.code == ERR_NONE)
+            err = parse_expression(ps, symbols, expressions[e].data(), expressions[e].size());
+        if(err.code == ERR_NONE)
+            err = simplify(ps.rpn, symbols, NULL, simplified);
+        if(err.code == ERR_NONE)
+            err = compile_rpn(simplified, symbols, simplifiedPrograms[e]);
+        if(err.code != ERR_NONE)
+        {
+            fprintf(stderr, "error: %s at position %zu of %s\n", error_message(err.code), err.pos, expressions[e].c_str());
+            return false;
+        }
+        std::vector<instruction>& code = simplifiedPrograms[e].code;
+        for(size_t i=0; i<code.size(); ++i)
+        {
+            if((code[i]&OP_MASK) != OP_LOAD)
+                continue;
+            const std::string& name = simplifiedPrograms[e].slots[code[i]>>OP_BITS];
+            int slot = (int)(std::find(programs[e].slots.begin(), programs[e].slots.end(), name)-programs[e].slots.begin());
+            code[i] = (instruction)slot<<OP_BITS | OP_LOAD;
+        }
+        simplifiedPrograms[e].slots = programs[e].slots;
+
+        const std::vector<std::string>& slots = programs[e].slots;
+        slotVals[e].resize((size_t)contextCount*slots.size());
+        init_batch(slots, contextCount, batches[e]);
+        for(int c=0; c<contextCount; ++c)
+            for(size_t s=0; s<slots.size(); ++s)
+            {
+                unsigned char val = contextVals[(size_t)c*vars+variableOf(slots[s])];
+                slotVals[e][c*slots.size()+s] = val;
+                set_batch_value(batches[e], (int)s, c, val);
+            }
+        build_truth_table(programs[e], truthTables[e]);
+
+        err = add_rule(rules, postFixes[e]);
+        if(err.code != ERR_NONE)
+            return false;
+    }
+
+    ruleVals.resize((size_t)contextCount*rules.slots.size());
+    init_batch(rules.slots, contextCount, ruleBatch);
+    for(int c=0; c<contextCount; ++c)
+        for(size_t s=0; s<rules.slots.size(); ++s)
+        {
+            unsigned char val = contextVals[(size_t)c*vars+variableOf(rules.slots[s])];
+            ruleVals[c*rules.slots.size()+s] = val;
+            set_batch_value(ruleBatch, (int)s, c, val);
+        }
+    init_incremental(rules, ruleVals.data(), incremental);
+    init_bdd(decisionDiagram, 1<<22);
+    bddReady = build_bdd(rules, decisionDiagram, bddRoots);
+    return true;
+}
+
+// ---- engines ----
+
+long long roundEvaluate(long long& trues)
+{
+    bool result = false;
+    for(size_t e=0; e<postFixes.size(); ++e)
+        for(int c=0; c<contextCount; ++c)
+        {
+            evaluate(postFixes[e], contexts[c], result);
+            trues += result;
+        }
+    return (long long)postFixes.size()*contextCount;
+}
+
+// bytecode of every expression on the slot values bound once per context
+long long runPrograms(const std::vector<program>& progs, long long& trues)
+{
+    for(size_t e=0; e<progs.size(); ++e)
+    {
+        size_t slots = progs[e].slots.size();
+        const unsigned char* vals = slotVals[e].data();
+        for(int c=0; c<contextCount; ++c)
+            trues += execute(progs[e], vals+c*slots);
+    }
+    return (long long)progs.size()*contextCount;
+}
+
+long long roundBytecode(long long& trues)
+{
+    return runPrograms(programs, trues);
+}
+
+long long roundSimplified(long long& trues)
+{
+    return runPrograms(simplifiedPrograms, trues);
+}
+
+long long countSelected(const std::vector<uint64_t>& bits)
+{
+    long long ones = 0;
+    for(size_t w=0; w<bits.size(); ++w)
+        ones += __builtin_popcountll(bits[w]);
+    return ones;
+}
+
+long long roundBatch(long long& trues)
+{
+    for(size_t e=0; e<programs.size(); ++e)
+    {
+        execute_batch(programs[e], batches[e], resultBits);
+        trues += countSelected(resultBits);
+    }
+    return (long long)programs.size()*contextCount;
+}
+
+// the threads are started per expression, as filter_batch does
+long long roundFilter(long long& trues)
+{
+    for(size_t e=0; e<programs.size(); ++e)
+    {
+        filter_batch(programs[e], batches[e], threads, resultBits);
+        trues += countSelected(resultBits);
+    }
+    return (long long)programs.size()*contextCount;
+}
+
+bool truthTablesReady()
+{
+    for(size_t e=0; e<programs.size(); ++e)
+        if(programs[e].slots.size() > TRUTH_TABLE_MAX_VARS)
+            return false;
+    return true;
+}
+
+long long roundTruthTable(long long& trues)
+{
+    for(size_t e=0; e<truthTables.size(); ++e)
+    {
+        size_t slots = programs[e].slots.size();
+        const unsigned char* vals = slotVals[e].data();
+        for(int c=0; c<contextCount; ++c)
+            trues += truth_lookup(truthTables[e], vals+c*slots);
+    }
+    return (long long)truthTables.size()*contextCount;
+}
+
+typedef struct _slot_values
+{
+    const unsigned char* vals;
+}SLOT_VALUES;
+
+bool lookupSlot(int slot, void* user)
+{
+    return ((SLOT_VALUES*)user)->vals[slot];
+}
+
+long long roundShortCircuit(long long& trues)
+{
+    SLOT_VALUES user;
+    for(size_t e=0; e<lazyPrograms.size(); ++e)
+    {
+        size_t slots = lazyPrograms[e].slots.size();
+        for(int c=0; c<contextCount; ++c)
+        {
+            user.vals = slotVals[e].data()+c*slots;
+            trues += execute_short_circuit(lazyPrograms[e], lookupSlot, &user, known, NULL);
+        }
+    }
+    return (long long)lazyPrograms.size()*contextCount;
+}
+
+long long roundRuleSet(long long& trues)
+{
+    for(int c=0; c<contextCount; ++c)
+    {
+        execute_rules(rules, &ruleVals[c*rules.slots.size()], nodeVals, ruleResults);
+        for(size_t r=0; r<ruleResults.size(); ++r)
+            trues += ruleResults[r];
+    }
+    return (long long)rules.roots.size()*contextCount;
+}
+
+long long roundRuleBatch(long long& trues)
+{
+    execute_rules_batch(rules, ruleBatch, nodeBits, resultBits);
+    trues += countSelected(resultBits);
+    return (long long)rules.roots.size()*contextCount;
+}
+
+// the rule values are brought from one context to the next by changing the variables that differ
+long long roundIncremental(long long& trues)
+{
+    size_t slots = rules.slots.size();
+    for(int c=0; c<contextCount; ++c)
+    {
+        for(size_t s=0; s<slots; ++s)
+            set_variable(incremental, (int)s, ruleVals[c*slots+s]);
+        changed.clear();
+        propagate(rules, incremental, changed);
+        for(size_t r=0; r<incremental.rule_vals.size(); ++r)
+            trues += incremental.rule_vals[r];
+    }
+    return (long long)rules.roots.size()*contextCount;
+}
+
+bool bddIsReady()
+{
+    return bddReady;
+}
+
+long long roundBdd(long long& trues)
+{
+    size_t slots = rules.slots.size();
+    for(size_t r=0; r<bddRoots.size(); ++r)
+        for(int c=0; c<contextCount; ++c)
+            trues += bdd_evaluate(decisionDiagram, bddRoots[r], &ruleVals[c*slots]);
+    return (long long)bddRoots.size()*contextCount;
+}
+
+ENGINE engines[] =
+{
+    {"evaluate", roundEvaluate, NULL},
+    {"bytecode", roundBytecode, NULL},
+    {"simplified", roundSimplified, NULL},
+    {"batch", roundBatch, NULL},
+    {"filter", roundFilter, NULL},
+    {"truth table", roundTruthTable, truthTablesReady},
+    {"short-circuit", roundShortCircuit, NULL},
+    {"rule set", roundRuleSet, NULL},
+    {"rule batch", roundRuleBatch, NULL},
+    {"incremental", roundIncremental, NULL},
+    {"bdd", roundBdd, bddIsReady},
+};
+
+// ---- parsers, one pass over all expressions, return the allocations made ----
+
+long long parseString()
+{
+    long long before = allocations.load();
+    for(size_t e=0; e<expressions.size(); ++e)
+        shuntingYard(expressions[e], operators, postFix);
+    return allocations.load()-before;
+}
+
+long long parseTyped()
+{
+    long long before = allocations.load();
+    for(size_t e=0; e<expressions.size(); ++e)
+        parse_expression(typedParser, typedSymbols, expressions[e].data(), expressions[e].size());
+    return allocations.load()-before;
+}
+
+long long parseCompile()
+{
+    long long before = allocations.load();
+    for(size_t e=0; e<postFixes.size(); ++e)
+        compile(postFixes[e], compiled);
+    return allocations.load()-before;
+}
+
+typedef struct _parse_bench
+{
+    const char* name;
+    long long (*pass)();
+    bool postFix;   // reads the post-fix strings instead of the in-fix ones
+}PARSE_BENCH;
+
+PARSE_BENCH parsers[] =
+{
+    {"shuntingYard", parseString, false},
+    {"parse_expression", parseTyped, false},
+    {"compile", parseCompile, true},
+};
+
+int main(int argc, const char * argv[])
+{
+    for(int i=1; i<argc; ++i)
+    {
+        if(strcmp(argv[i], "-depth")==0 && i+1<argc)
+            depth = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-vars")==0 && i+1<argc)
+            vars = std::max(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "-mix")==0 && i+1<argc)
+            sscanf(argv[++i], "%d,%d,%d,%d", &mix[0], &mix[1], &mix[2], &mix[3]);
+        else if(strcmp(argv[i], "-rules")==0 && i+1<argc)
+            ruleCount = std::max(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "-contexts")==0 && i+1<argc)
+            contextCount = std::max(1, atoi(argv[++i]));
+        else if(strcmp(argv[i], "-flips")==0 && i+1<argc)
+            flips = atoi(argv[++i]);
+        else if(strcmp(argv[i], "-seed")==0 && i+1<argc)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-time")==0 && i+1<argc)
+            minSeconds = atof(argv[++i]);
+        else if(strcmp(argv[i], "-threads")==0 && i+1<argc)
+            threads = std::max(1, atoi(argv[++i]));
+    }
+    for(int k=0; k<4; ++k)
+        mix[k] = std::max(0, mix[k]);
+    if(mix[0]+mix[1]+mix[2]+mix[3] == 0)
+    {
+        fprintf(stderr, "error: empty operator mix\n");
+        return 1;
+    }
+
+    std::mt19937_64 rng(seed);
+    size_t textBytes = 0;
+    for(int r=0; r<ruleCount; ++r)
+    {
+        expressions.push_back(generateExpression(rng, depth));
+        textBytes += expressions.back().size();
+    }
+    generateContexts(rng);
+    if(!prepare())
+        return 1;
+    size_t postFixBytes = 0;
+    for(size_t e=0; e<postFixes.size(); ++e)
+        postFixBytes += postFixes[e].size();
+    printf("%d expressions of depth %d over %d variables, %.1f KB of text, %d contexts, %zu shared nodes\n",
+           ruleCount, depth, vars, textBytes/1024.0, contextCount, rules.nodes.size());
+
+    printf("\n%-18s %10s %12s %12s\n", "parser", "seconds", "MB/s", "allocs/expr");
+    for(size_t p=0; p<sizeof(parsers)/sizeof(parsers[0]); ++p)
+    {
+        long long passes = 0, allocs = 0;
+        double start = now(), elapsed;
+        do
+        {
+            allocs += parsers[p].pass();
+            passes++;
+            elapsed = now()-start;
+        }while(elapsed < minSeconds);
+        double bytes = (double)passes*(parsers[p].postFix ? postFixBytes : textBytes);
+        printf("%-18s %10.4f %12.1f %12.2f\n", parsers[p].name, elapsed, bytes/elapsed/1e6,
+               (double)allocs/(passes*expressions.size()));
+    }
+
+    printf("\n%-18s %10s %14s %12s %12s\n", "engine", "seconds", "evals/s", "allocs/eval", "true");
+    long long reference = -1;
+    for(size_t k=0; k<sizeof(engines)/sizeof(engines[0]); ++k)
+    {
+        const ENGINE& engine = engines[k];
+        if(engine.ready && !engine.ready())
+        {
+            printf("%-18s skipped, the input is too large for it\n", engine.name);
+            continue;
+        }
+        long long rounds = 0, evals = 0, trues = 0, roundTrues = 0;
+        long long before = allocations.load();
+        double start = now(), elapsed;
+        do
+        {
+            trues = 0;
+            evals += engine.round(trues);
+            if(rounds++ == 0)
+                roundTrues = trues;
+            elapsed = now()-start;
+        }while(elapsed < minSeconds);
+        long long allocs = allocations.load()-before;
+        if(reference == -1)
+            reference = roundTrues;
+        printf("%-18s %10.4f %14.0f %12.4f %12lld%s\n", engine.name, elapsed, evals/elapsed,
+               (double)allocs/evals, roundTrues, roundTrues!=reference || trues!=roundTrues ? "*" : "");
+    }
+    return 0;
+}